@@ -0,0 +1,85 @@
+#ifndef TOY_LANG_ARENA
+#define TOY_LANG_ARENA
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Bump allocator for objects that share one lifetime. Objects placed in an
+// arena are never destroyed individually, so they must not own resources;
+// releasing the arena frees whole blocks at once.
+class Arena {
+    std::vector<std::unique_ptr<char[]>> blocks;
+    char* cursor = nullptr;
+    char* limit = nullptr;
+    size_t blockSize;
+    size_t used = 0;
+
+public:
+    explicit Arena(size_t blockSize = 64 * 1024);
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    Arena(Arena&& other) noexcept;
+    Arena& operator=(Arena&& other) noexcept;
+
+    void* allocate(size_t size, size_t align);
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    template <typename T>
+    T* allocateArray(size_t count) {
+        if (count == 0) {
+            return nullptr;
+        }
+        T* items = static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+        for (size_t i = 0; i < count; i++) {
+            new (items + i) T();
+        }
+        return items;
+    }
+
+    std::string_view copyString(std::string_view text);
+
+    size_t bytesUsed() const { return used; }
+
+private:
+    void grow(size_t minimum);
+};
+
+// A fixed-size array living in an Arena.
+template <typename T>
+class ArenaSpan {
+    T* items = nullptr;
+    size_t count = 0;
+
+public:
+    ArenaSpan() = default;
+    ArenaSpan(T* items, size_t count) : items(items), count(count) {}
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    T* begin() const { return items; }
+    T* end() const { return items + count; }
+
+    T& operator[](size_t index) const { return items[index]; }
+};
+
+template <typename T, typename Iterator>
+ArenaSpan<T> copyToArena(Arena& arena, Iterator first, Iterator last) {
+    size_t count = static_cast<size_t>(last - first);
+    T* items = arena.allocateArray<T>(count);
+    for (size_t i = 0; i < count; i++, ++first) {
+        items[i] = *first;
+    }
+    return ArenaSpan<T>(items, count);
+}
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef TOY_LANG_BIGINT
+#define TOY_LANG_BIGINT
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// An integer of any size: a sign and a magnitude in 32-bit limbs, least
+// significant first and without leading zeros. Zero has no limbs and is
+// never negative. Division truncates toward zero, as it does for int64_t.
+class BigInt {
+    bool negative = false;
+    std::vector<uint32_t> limbs;
+
+public:
+    BigInt() = default;
+    explicit BigInt(int64_t value);
+
+    // Decimal digits, optionally preceded by '-'. Returns false if `text`
+    // is anything else.
+    static bool parse(std::string_view text, BigInt& result);
+    std::string toString() const;
+
+    bool isZero() const { return limbs.empty(); }
+    // Limbs in the magnitude, which is what arithmetic on it costs.
+    size_t size() const { return limbs.size(); }
+    bool isNegative() const { return negative; }
+    bool fitsInt64() const;
+    // Only meaningful when fitsInt64.
+    int64_t toInt64() const;
+    size_t hash() const;
+
+    // Dividing by zero is for the caller to rule out.
+    friend BigInt operator+(const BigInt& left, const BigInt& right);
+    friend BigInt operator-(const BigInt& left, const BigInt& right);
+    friend BigInt operator*(const BigInt& left, const BigInt& right);
+    friend BigInt operator/(const BigInt& left, const BigInt& right);
+
+    friend bool operator==(const BigInt& left, const BigInt& right) {
+        return left.negative == right.negative && left.limbs == right.limbs;
+    }
+    friend bool operator<(const BigInt& left, const BigInt& right);
+
+private:
+    BigInt(bool negative, std::vector<uint32_t> limbs);
+};
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef TOY_LANG_BUDGET
+#define TOY_LANG_BUDGET
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include "value.h"
+
+// Limits on one run of a function; zero means no limit. A function body
+// has no loops, so the number of calls bounds the work a run does.
+struct RunLimits {
+    uint64_t maxCalls = 0;  // tail calls included
+    size_t maxDepth = 0;    // calls in progress at once
+    std::chrono::milliseconds timeout{0};
+
+    bool any() const { return maxCalls || maxDepth || timeout.count(); }
+};
+
+// Enforces RunLimits for an engine, which reports every call to it. A call
+// costs a decrement and a compare; the call count and the clock are only
+// looked at when the countdown runs out, at most CHECK_INTERVAL calls apart
+// while there is a timeout. Arithmetic on big values can take any time
+// within one call, so the engines report it too, and the clock is also read
+// once WORK_INTERVAL limbs have been operated on since it last was.
+// Exceeding a limit raises LimitError.
+class CallBudget {
+    static constexpr uint64_t CHECK_INTERVAL = 4096;
+    static constexpr uint64_t WORK_INTERVAL = 4096;
+
+    RunLimits limits;
+    uint64_t countdown = UINT64_MAX;
+    uint64_t issued = UINT64_MAX;  // what the countdown last started from
+    uint64_t spent = 0;            // calls before it did
+    uint64_t workLeft = WORK_INTERVAL;  // limbs until the clock is read
+    size_t depth = 0;
+    size_t maxDepth = SIZE_MAX;
+    std::chrono::steady_clock::time_point deadline;
+
+public:
+    void setLimits(const RunLimits& newLimits);
+    const RunLimits& getLimits() const { return limits; }
+
+    // Starts the budget of a new run.
+    void start();
+
+    void enter() {
+        if (--countdown == 0) {
+            refill();
+        }
+        if (++depth > maxDepth) {
+            tooDeep();
+        }
+    }
+    void leave() { depth--; }
+    // A tail call counts, but replaces its caller instead of nesting.
+    void replace() {
+        if (--countdown == 0) {
+            refill();
+        }
+    }
+    // Called before each arithmetic operation; costs two tests unless an
+    // operand is big.
+    void operate(const Value& left, const Value& right) {
+        if (left.isBig() || right.isBig()) {
+            operateBig(left, right);
+        }
+    }
+
+private:
+    void refill();
+    void issue();
+    void operateBig(const Value& left, const Value& right);
+    void checkClock();
+    [[noreturn]] void tooDeep() const;
+};
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef TOY_LANG_BYTECODE
+#define TOY_LANG_BYTECODE
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "symbol.h"
+#include "value.h"
+
+enum class OpCode : uint8_t {
+    PUSH_CONST,     // push constants[operand]
+    LOAD_LOCAL,     // push frame slot operand
+    LOAD_OUTER,     // push the enclosing frame slot described by outers[operand]
+    STORE_LOCAL,    // pop into frame slot operand
+    ADD,
+    SUB,
+    MUL,
+    DIV,
+    EQ,
+    NOT_EQ,
+    LESS,
+    JUMP,           // ip = operand
+    JUMP_IF_FALSE,  // pop, ip = operand if zero
+    LOAD_FUNC,      // resolve and arity-check the callee of calls[operand]
+    CALL,           // call the callee resolved by the matching LOAD_FUNC
+    TAIL_CALL,      // like CALL, but replaces the current frame when possible
+    DEFINE_FUNC,    // define nested[operand] in the current frame
+    POP,
+    RETURN
+};
+
+// Instructions are packed into 32-bit words: the opcode in the low byte and
+// a 24-bit operand above it.
+using Instruction = uint32_t;
+
+constexpr uint32_t MAX_OPERAND = 0xFFFFFF;
+
+inline Instruction encode(OpCode op, uint32_t operand = 0) {
+    return static_cast<uint32_t>(op) | (operand << 8);
+}
+
+inline OpCode opcodeOf(Instruction instr) {
+    return static_cast<OpCode>(instr & 0xFF);
+}
+
+inline uint32_t operandOf(Instruction instr) {
+    return instr >> 8;
+}
+
+struct CallSite {
+    Symbol callee;
+    uint32_t argc;
+};
+
+struct OuterRef {
+    uint32_t depth;
+    uint32_t slot;
+    Symbol name;  // for error messages
+};
+
+struct CompiledFunction {
+    Symbol name;
+    std::vector<Symbol> params;
+    size_t frameSize = 0;
+    bool pure = false;
+
+    std::vector<Instruction> code;
+    std::vector<Value> constants;
+    std::vector<CallSite> calls;
+    std::vector<OuterRef> outers;
+    std::vector<std::unique_ptr<CompiledFunction>> nested;
+};
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef TOY_LANG_COMPILER
+#define TOY_LANG_COMPILER
+
+#include <map>
+#include <memory>
+#include "visitor.h"
+#include "parser.h"
+#include "bytecode.h"
+
+
+class Compiler : public Visitor {
+    CompiledFunction& target;
+    std::map<int64_t, uint32_t> constantIndex;
+    bool tailPosition = false;
+
+public:
+    Compiler(CompiledFunction& target);
+
+    static std::unique_ptr<CompiledFunction> compile(FunctionDefAST& functionDef);
+
+    void visit(ExprAST& expr) override;
+    void visit(NumberAST& number) override;
+    void visit(IdentifierAST& identifier) override;
+    void visit(BinaryOpAST& binary) override;
+    void visit(TernaryExprAST& ternary) override;
+    void visit(FunctionCallAST& call) override;
+    void visit(StatementAST& stmt) override;
+    void visit(AssignmentAST& assignment) override;
+    void visit(ReturnStmtAST& returnStmt) override;
+    void visit(FunctionDefAST& functionDef) override;
+
+private:
+    size_t emit(OpCode op, uint32_t operand = 0);
+    void patch(size_t at, uint32_t operand);
+    uint32_t checked(size_t index);
+    uint32_t addConstant(const Value& value);
+};
+
+#endif
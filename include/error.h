@@ -1,7 +1,9 @@
 #ifndef TOY_LANG_ERROR
 #define TOY_LANG_ERROR
 
+#include <exception>
 #include <stdexcept>
+#include <string>
 
 struct SyntaxError : public std::runtime_error {
   using std::runtime_error::runtime_error;
@@ -15,4 +17,28 @@ struct NameError : public std::runtime_error {
   using std::runtime_error::runtime_error;
 };
 
+// A run went over one of its RunLimits.
+struct LimitError : public std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+// One-line description of a captured error, as printed by the command line.
+inline std::string describeError(const std::exception_ptr& error) {
+  try {
+    std::rethrow_exception(error);
+  } catch (const SyntaxError& e) {
+    return std::string("Syntax Error: ") + e.what();
+  } catch (const NameError& e) {
+    return std::string("Name Error: ") + e.what();
+  } catch (const RuntimeError& e) {
+    return std::string("Runtime Error: ") + e.what();
+  } catch (const LimitError& e) {
+    return std::string("Limit Error: ") + e.what();
+  } catch (const std::exception& e) {
+    return std::string("Error: ") + e.what();
+  } catch (...) {
+    return "Error: unknown exception";
+  }
+}
+
 #endif 
\ No newline at end of file
@@ -0,0 +1,86 @@
+#ifndef TOY_LANG_FLAT_AST
+#define TOY_LANG_FLAT_AST
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "parser.h"
+#include "symbol.h"
+#include "value.h"
+
+// A node of a FlatFunction: a fixed-size record whose children are indices
+// into the same function's node array. What the fields hold depends on
+// the kind:
+//
+//   NUMBER        a, b = low and high word of the value, or, with count
+//                 set, a = index of a big value in `constants`
+//   IDENTIFIER    a = slot, b = depth, c = name
+//   BINARY_OP     op, a = left, b = right
+//   TERNARY       a = condition, b = then, c = else
+//   CALL          a = callee, b = first argument in `arguments`, c = call site,
+//                 count = argument count
+//   ASSIGNMENT    a = slot, b = value
+//   RETURN        a = expression
+//   FUNCTION_DEF  a = index in `nested`
+struct FlatNode {
+    // In the order of RuntimeStats::Node.
+    enum class Kind : uint8_t { NUMBER, IDENTIFIER, BINARY_OP, TERNARY, CALL, ASSIGNMENT, RETURN, FUNCTION_DEF };
+
+    Kind kind;
+    char op = 0;
+    uint16_t count = 0;
+    uint32_t a = 0;
+    uint32_t b = 0;
+    uint32_t c = 0;
+};
+
+static_assert(sizeof(FlatNode) == 16, "FlatNode should stay four words");
+
+// One function of the program laid out for the tree-walking Evaluator:
+// all of its nodes in a single array, parents before their children, so
+// that evaluating an expression walks forward through memory instead of
+// chasing pointers. Built from the AST once the passes that rewrite it
+// have run, and never changed afterwards.
+struct FlatFunction {
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    Symbol name = 0;
+    size_t paramCount = 0;
+    size_t frameSize = 0;
+    bool pure = false;
+
+    std::vector<FlatNode> nodes;
+    std::vector<Value> constants;     // literals too large for a node
+    std::vector<uint32_t> arguments;  // argument nodes of the calls, each call's together
+    std::vector<uint32_t> body;       // statement nodes in order
+    uint32_t returnExpr = NONE;
+    std::vector<FlatFunction> nested;
+
+    // Numbers the calls from `callSites` on, advancing it past them.
+    static FlatFunction flatten(const FunctionDefAST& func, uint32_t& callSites);
+};
+
+// The flat functions of a whole program, with its call sites numbered
+// across all of them so that per-context caches can be indexed by site.
+class FlatProgram {
+    std::vector<FlatFunction> functions;
+    std::vector<const FlatFunction*> targets;
+
+public:
+    FlatProgram() = default;
+    explicit FlatProgram(const std::vector<FunctionDefAST*>& ast);
+
+    // Moving keeps the functions where they are, so pointers to them stay
+    // valid.
+    FlatProgram(FlatProgram&&) = default;
+    FlatProgram& operator=(FlatProgram&&) = default;
+
+    const std::vector<FlatFunction>& getFunctions() const { return functions; }
+    size_t getCallSiteCount() const { return targets.size(); }
+
+    // The top-level function a call site reaches from any frame, or nullptr
+    // when that depends on the functions its callers define.
+    const FlatFunction* getTarget(uint32_t site) const { return targets[site]; }
+};
+
+#endif
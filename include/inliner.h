@@ -0,0 +1,99 @@
+#ifndef TOY_LANG_INLINER
+#define TOY_LANG_INLINER
+
+#include <cstddef>
+#include <map>
+#include <set>
+#include <vector>
+#include "visitor.h"
+#include "parser.h"
+
+// The calls from one function to another that were replaced by the callee's
+// body.
+struct InlinedCall {
+    Symbol caller;
+    Symbol callee;
+    size_t sites;
+};
+
+// Replaces calls to small non-recursive top-level functions in a resolved
+// program by the callee's body, turned into one expression: every use of a
+// parameter or local becomes the argument or assigned value it holds.
+// Identifiers are already bound to slots, so nothing can be captured. A
+// call is only inlined when that keeps every observable effect (an error,
+// a call) in its original order: an argument or local that might fail or
+// call must be used exactly once, unconditionally and after everything
+// bound before it; values that cannot fail may be dropped, and repeated
+// only when they are literals or locals of the caller. Function lookup is
+// dynamic, so a call only reaches a top-level function when no nested def
+// anywhere uses its name; calls with the wrong number of arguments are
+// left to fail as before.
+class Inliner : public Visitor {
+public:
+    // Inline callees whose assignments and return hold at most this many
+    // expression nodes.
+    static constexpr size_t DEFAULT_LIMIT = 16;
+
+private:
+    enum class State { Unvisited, Open, Done };
+
+    // A value the inlined body may refer to: an argument, evaluated in the
+    // caller, or the value of one of the callee's assignments, whose
+    // identifiers refer to the bindings in `scope`.
+    struct Binding {
+        ExprAST* value;
+        bool inCaller;
+        std::vector<int> scope;
+        bool mayFail = false;
+        ExprAST* leaf = nullptr;  // a literal or caller local, copied to every use
+        size_t uses = 0;
+    };
+
+    Arena& arena;
+    size_t limit;
+    std::map<Symbol, FunctionDefAST*> globals;
+    std::set<Symbol> nestedNames;
+    std::map<FunctionDefAST*, State> states;
+    std::set<const FunctionDefAST*> recursive;
+    std::vector<FunctionDefAST*> open;     // top-level functions being rewritten
+    std::vector<FunctionDefAST*> callers;  // the innermost one is being visited
+    std::vector<InlinedCall> report;
+    ExprAST* replacement = nullptr;
+
+    // The call being inlined.
+    std::vector<Binding> bindings;
+    int seen = -1;  // the latest binding an effect came from
+
+public:
+    Inliner(Arena& arena, size_t limit);
+
+    // Returns what was inlined, by caller and callee in the order first
+    // inlined. A limit of 0 inlines nothing.
+    static std::vector<InlinedCall> inlineCalls(ProgramAST& program, size_t limit = DEFAULT_LIMIT);
+
+    void visit(ExprAST& expr) override;
+    void visit(NumberAST& number) override;
+    void visit(IdentifierAST& identifier) override;
+    void visit(BinaryOpAST& binary) override;
+    void visit(TernaryExprAST& ternary) override;
+    void visit(FunctionCallAST& call) override;
+    void visit(StatementAST& stmt) override;
+    void visit(AssignmentAST& assignment) override;
+    void visit(ReturnStmtAST& returnStmt) override;
+    void visit(FunctionDefAST& functionDef) override;
+
+private:
+    void process(FunctionDefAST& function);
+    ExprAST* rewrite(ExprAST* expr);
+    FunctionDefAST* target(const FunctionCallAST& call) const;
+    bool canInline(const FunctionDefAST& callee) const;
+    ExprAST* inlineCall(const FunctionCallAST& call, const FunctionDefAST& callee);
+
+    ExprAST* expand(ExprAST* expr, const std::vector<int>* scope, int origin, bool inArm);
+    ExprAST* reference(int index, bool inArm);
+    void effect(int origin);
+    bool mayFail(ExprAST* expr, const std::vector<int>* scope) const;
+    ExprAST* copyLeaf(ExprAST* leaf);
+};
+
+#endif
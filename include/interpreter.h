@@ -1,80 +1,259 @@
 #ifndef TOY_LANG_INTERPRETER
 #define TOY_LANG_INTERPRETER
 
+#include <exception>
 #include <istream>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
 #include <memory>
-#include "visitor.h"
 #include "parser.h"
-#include "tokenzier.h"
+#include "flat_ast.h"
+#include "bytecode.h"
+#include "vm.h"
+#include "program.h"
+#include "memo.h"
+#include "profiler.h"
+#include "stats.h"
+#include "thread_pool.h"
+#include "value.h"
 
 
 class Environment;
 
 
-class Value {
-public:
-    virtual ~Value() = default;
-    virtual int asInt() const = 0;
-};
+// The tree-walker's state in one ExecutionContext: the memo cache and
+// profiler in use, and what each call site last resolved to.
+struct EvaluatorState {
+    struct CachedCall {
+        uint64_t epoch = 0;
+        const FlatFunction* function = nullptr;
+        Environment* scope = nullptr;
+    };
 
-class IntValue : public Value {
-    int value;
-public:
-    IntValue(int val) : value(val) {}
-    int asInt() const override { return value; }
-};
+    const FlatProgram& program;
+    Environment& globals;
+    CallBudget& budget;
+    MemoCache* memo = nullptr;
+    Profiler* profiler = nullptr;
+
+    // A cached callee is valid while `epoch` is what it was when the call
+    // was resolved. What a name resolves to only changes when a function
+    // is defined or a frame that defined some goes away, and both advance
+    // the epoch.
+    std::vector<CachedCall> calls;
+    uint64_t epoch = 1;
 
+    // Calls recurse in C++. A run may take `stackLimit` bytes of stack in
+    // all; once the thread's own stack runs out before that, it goes on on
+    // a new thread with a stack of what is left. Calls fail or move on at
+    // `stackFloor`, on the stack that started at `stackTop`.
+    size_t stackLimit = 0;
+    size_t stackUsed = 0;  // on the stacks of the threads waiting for it
+    uintptr_t stackTop = 0;
+    uintptr_t stackFloor = 0;
 
-class Evaluator : public Visitor {
+    // Frames of finished calls, reused by later ones so that most calls
+    // allocate nothing.
+    static constexpr size_t MAX_SPARE_FRAMES = 64;
+    std::vector<std::unique_ptr<Environment>> spareFrames;
+
+    EvaluatorState(const FlatProgram& program, Environment& globals, CallBudget& budget)
+        : program(program), globals(globals), budget(budget), calls(program.getCallSiteCount()) {
+        spareFrames.reserve(MAX_SPARE_FRAMES);
+    }
+
+    std::unique_ptr<Environment> newFrame(Environment& parent, Environment* enclosing, size_t frameSize);
+    void recycle(std::unique_ptr<Environment> frame) noexcept;
+    // Starts using the stack of the calling thread from `top` down.
+    void useStack(uintptr_t top);
+    [[noreturn]] void stackOverflow() const;
+};
+
+// Walks the flat nodes of one function, dispatching on their kind.
+class Evaluator {
+    const FlatFunction& function;
     Environment& env;
-    std::unique_ptr<Value> result;
+    EvaluatorState& state;
 
 public:
-    Evaluator(Environment& env);
-    
-    std::unique_ptr<Value> evaluate(NodeAST* node);
-    
-    void visit(ExprAST& expr) override;
-    void visit(NumberAST& number) override;
-    void visit(IdentifierAST& identifier) override;
-    void visit(BinaryOpAST& binary) override;
-    void visit(TernaryExprAST& ternary) override;
-    void visit(FunctionCallAST& call) override;
-    void visit(StatementAST& stmt) override;
-    void visit(AssignmentAST& assignment) override;
-    void visit(ReturnStmtAST& returnStmt) override;
-    void visit(FunctionDefAST& functionDef) override;
+    Evaluator(const FlatFunction& function, Environment& env, EvaluatorState& state);
+    
+    // Evaluates node `index` of the function; statements yield Nil.
+    Value evaluate(uint32_t index);
+    
+    // Runs a function in its prepared frame, consulting the memo cache
+    // first when the function is pure and recording the call in the
+    // profiler, when the state has them.
+    static Value callFunction(const FlatFunction* func, std::unique_ptr<Environment> funcEnv, EvaluatorState& state);
+
+private:
+    static Value callProfiled(const FlatFunction* func, std::unique_ptr<Environment> funcEnv, EvaluatorState& state);
+    static Value callMemoized(const FlatFunction* func, std::unique_ptr<Environment> funcEnv, EvaluatorState& state);
+    // Calls in tail position reuse the loop instead of recursing, so
+    // tail-recursive scripts run in constant C++ stack and keep a single
+    // frame alive.
+    static Value runFunction(const FlatFunction* func, std::unique_ptr<Environment> funcEnv, EvaluatorState& state);
+    static Value runOnNewStack(const FlatFunction* func, std::unique_ptr<Environment> funcEnv, EvaluatorState& state,
+                               uintptr_t here);
+    Environment* resolve(const FlatNode& call, const FlatFunction*& func);
+    std::unique_ptr<Environment> prepareCall(const FlatNode& call, Environment& parent, const FlatFunction*& func);
+    const Value& variable(const FlatNode& identifier);
+    // The value of an operand node, evaluated into `scratch` unless it can
+    // be referred to where it is.
+    const Value& operand(uint32_t index, Value& scratch);
+    uint32_t evaluateTail(uint32_t index, Value& result);
+    bool evaluateCondition(const FlatNode& ternary);
 };
 
 
+// A call frame. Variables live in slots assigned by the Resolver and are
+// reached through the lexical `enclosing` chain; functions are still looked
+// up dynamically through the `parent` (caller) chain.
 class Environment {
-    std::map<std::string, std::unique_ptr<Value>> variables;
-    std::map<std::string, std::unique_ptr<FunctionDefAST>> functions;
+    std::vector<Value> slots;
+    std::map<Symbol, const FlatFunction*> functions;
     Environment* parent;
+    Environment* enclosing;
+    
+public:
+    Environment(Environment* parent = nullptr, Environment* enclosing = nullptr, size_t frameSize = 0);
+    
+    // Makes a spare frame a fresh one, as the constructor would.
+    void reset(Environment* parent, Environment* enclosing, size_t frameSize);
+    void clear() noexcept;
+    
+    void defineVariable(int slot, Value value);
+    Value* getVariable(int depth, int slot);
+    const Value* getSlots() const { return slots.data(); }
+    
+    // Definitions belong to the Program and outlive every frame, so
+    // defining a function only records a pointer to it.
+    void defineFunction(const FlatFunction& func);
+    const FlatFunction* getFunction(Symbol name, Environment** scope = nullptr);
+    bool definesFunctions() const { return !functions.empty(); }
+    
+    Environment* getParent() const { return parent; }
+    
+    std::unique_ptr<Environment> createChildEnv(Environment* enclosing, size_t frameSize);
+};
+
+// Jit is the bytecode VM running native code for the functions that can
+// have it (see JitModule), except while memoizing, profiling or limiting
+// runs.
+enum class Engine { Bytecode, TreeWalker, Jit };
+
+// Per-thread state for running a shared Program: the VM's stacks and the
+// memo cache. Contexts are cheap to create, and the Program they run is never
+// written to, so each thread can run its own context without locks.
+class ExecutionContext {
+    std::shared_ptr<const Program> program;
+    Engine engine;
+    CallBudget budget;
+    VirtualMachine vm;
+    std::unique_ptr<MemoCache> memo;
+    std::unique_ptr<Profiler> profiler;
+    std::unique_ptr<EvaluatorState> treeState;
+    RuntimeStats stats;
     
 public:
-    Environment(Environment* parent = nullptr);
+    explicit ExecutionContext(std::shared_ptr<const Program> program, Engine engine = Engine::Bytecode);
+    
+    Value run(const std::string& function_name, const std::vector<Value>& args);
+    Value run(Symbol name, const std::vector<Value>& args);
+    
+    // Calls the function once per row, with args[i][row] as its i-th
+    // argument, and sets results[row] to what it returns. Rows are evaluated
+    // in SIMD lanes where the function allows it (see LaneEvaluator). The
+    // first row that fails raises its error.
+    void runColumns(const std::string& function_name, const std::vector<const int64_t*>& args, size_t rows,
+                    int64_t* results);
+    
+    // Memoizes calls to pure functions in a cache of at most `capacity`
+    // entries, kept across runs of this context.
+    void enableMemoization(size_t capacity);
+    const MemoCache* getMemoCache() const { return memo.get(); }
     
-    void defineVariable(const std::string& name, std::unique_ptr<Value> value);
-    Value* getVariable(const std::string& name);
+    // Records calls, with their callers and wall time, across runs of this
+    // context.
+    void enableProfiling();
+    const Profiler* getProfiler() const { return profiler.get(); }
     
-    void defineFunction(const std::string& name, std::unique_ptr<FunctionDefAST> func);
-    FunctionDefAST* getFunction(const std::string& name);
+    // Applies to every later run of this context. Native code cannot be
+    // stopped, so a context with limits leaves JIT functions to the VM.
+    void setLimits(const RunLimits& limits);
+    const RunLimits& getLimits() const { return budget.getLimits(); }
+    
+    // Memory the call stack of a run may take: the VM's frames (see
+    // VirtualMachine), or the C++ stacks the tree-walker recurses on.
+    void setStackLimit(size_t bytes) { vm.setStackLimit(bytes); }
+    size_t getStackLimit() const { return vm.getStackLimit(); }
+    
+    // Counts of what the engine did in runs of this context; all zero in a
+    // build without TOY_STATS.
+    const RuntimeStats& getStats() const { return stats; }
+    
+    const Program& getProgram() const { return *program; }
+    Engine getEngine() const { return engine; }
+
+private:
+    Value runTreeWalker(Symbol name, const std::vector<Value>& args);
+};
+
+// Outcome of one call in a batch: either a value or the exception it raised.
+struct BatchResult {
+    Value value;
+    std::exception_ptr error;
     
-    std::unique_ptr<Environment> createChildEnv();
+    bool ok() const { return !error; }
 };
 
+// Loads a script and runs it on one ExecutionContext, or on one context per
+// pool thread for batches.
 class Interpreter {
-    std::unique_ptr<Environment> global_env;
-    std::vector<std::unique_ptr<FunctionDefAST>> functions;
+    std::shared_ptr<const Program> program;
+    ExecutionContext context;
+    
+    size_t threadCount = 0;
+    std::unique_ptr<ThreadPool> pool;
+    std::vector<std::unique_ptr<ExecutionContext>> workers;
     
 public:
-    Interpreter(std::istream& input);
+    Interpreter(std::istream& input, Engine engine = Engine::Bytecode, bool optimize = true);
+    Interpreter(std::string_view source, Engine engine = Engine::Bytecode, bool optimize = true);
+    explicit Interpreter(std::shared_ptr<const Program> program, Engine engine = Engine::Bytecode);
+    
+    Value run(const std::string& function_name, const std::vector<Value>& args);
+    
+    // See ExecutionContext::runColumns.
+    void runColumns(const std::string& function_name, const std::vector<const int64_t*>& args, size_t rows,
+                    int64_t* results);
+    
+    // Calls the function once per argument tuple in parallel and returns the
+    // results in input order. A failing call only fails its own entry.
+    std::vector<BatchResult> runBatch(const std::string& function_name, const std::vector<std::vector<Value>>& args);
     
-    int run(const std::string& function_name, std::vector<int> args);
+    // Threads used by runBatch; zero means one per hardware thread.
+    void setThreadCount(size_t count);
+    
+    void enableMemoization(size_t capacity);
+    const MemoCache* getMemoCache() const { return context.getMemoCache(); }
+    
+    void enableProfiling();
+    void setLimits(const RunLimits& limits);
+    void setStackLimit(size_t bytes);
+    // The calls recorded so far by run and runBatch together; empty unless
+    // profiling is enabled.
+    Profiler getProfile() const;
+    
+    // Counters of run and runBatch together, see RuntimeStats.
+    RuntimeStats getStats() const;
+    
+    std::shared_ptr<const Program> getProgram() const { return program; }
+
+private:
+    void startWorkers();
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,55 @@
+#ifndef TOY_LANG_JIT
+#define TOY_LANG_JIT
+
+#include <cstddef>
+#include <unordered_map>
+#include "bytecode.h"
+#include "value.h"
+
+class Program;
+
+// Native x86-64 code for the integer functions of a Program, built on
+// Linux/x86-64 only. A top-level function is compiled, together with the
+// functions it defines, when every call it makes can be resolved before it
+// runs: to one of its own nested functions, or to a compiled top-level
+// function whose name no function anywhere defines as nested. Everything
+// else is left to the VM, which enters native code whenever it calls a
+// compiled function. Native code computes with 64-bit integers only, and
+// gives a call back to the VM when it meets anything larger. The code is
+// never written to once built, so a module can be shared by any number of
+// threads.
+class JitModule {
+    void* memory = nullptr;
+    size_t size = 0;
+    std::unordered_map<const CompiledFunction*, const void*> entries;
+
+public:
+    explicit JitModule(const Program& program);
+    ~JitModule();
+
+    JitModule(const JitModule&) = delete;
+    JitModule& operator=(const JitModule&) = delete;
+
+    // Whether this build can generate code at all.
+    static bool isSupported();
+
+    // The native code of a top-level function, or nullptr if it has none.
+    const void* find(const CompiledFunction* function) const {
+        if (entries.empty()) {
+            return nullptr;
+        }
+        auto it = entries.find(function);
+        return it == entries.end() ? nullptr : it->second;
+    }
+
+    // Runs code returned by find with as many arguments as the function
+    // takes. Errors are raised as the VM raises them. Returns false, having
+    // had no effect, if an argument or a result along the way does not fit
+    // in 64 bits or the recursion runs out of native stack; the VM has to
+    // run the call instead.
+    bool call(const void* code, const Value* args, size_t argc, Value& result) const;
+
+    size_t getCompiledCount() const { return entries.size(); }
+};
+
+#endif
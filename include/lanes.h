@@ -0,0 +1,58 @@
+#ifndef TOY_LANG_LANES
+#define TOY_LANG_LANES
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "flat_ast.h"
+#include "symbol.h"
+
+class ExecutionContext;
+
+// Evaluates one top-level function over many rows of arguments in lockstep,
+// WIDTH rows to a block: every node computes a column with one lane per row,
+// using AVX2 where the CPU has it and SSE2 or plain loops otherwise. A
+// ternary becomes a select, with each branch evaluated only for the lanes
+// that take it. What has no lane form is done one lane at a time by the
+// context's engine: calls, and every row on which something would overflow
+// 64 bits, divide by zero or read an undefined variable. Such a row is run
+// again from the start, so its result or error is exactly what `run` gives.
+class LaneEvaluator {
+public:
+    static constexpr size_t WIDTH = 64;
+
+private:
+    struct alignas(32) Column {
+        int64_t lane[WIDTH];
+    };
+
+    const FlatFunction& function;
+    Symbol name;
+    ExecutionContext& context;
+
+    std::vector<Column> columns;        // the result of each node
+    std::vector<const int64_t*> slots;  // nullptr while undefined
+    uint64_t failed = 0;                // lanes to run again
+
+public:
+    LaneEvaluator(const FlatFunction& function, Symbol name, ExecutionContext& context);
+
+    // Functions that define functions or hold literals too large for 64
+    // bits are run one row at a time.
+    static bool supports(const FlatFunction& function);
+
+    // Sets results[row] to the function's result for the arguments
+    // args[0][row], args[1][row], ... Rows are finished in order, and the
+    // first row that fails raises its error. A result that does not fit in
+    // 64 bits is an error too.
+    void run(const std::vector<const int64_t*>& args, size_t rows, int64_t* results);
+
+private:
+    // The lanes of `active` that have to be run again.
+    uint64_t runBlock(const int64_t* const* args, uint64_t active, int64_t* results);
+    const int64_t* evaluate(uint32_t index, uint64_t active);
+    const int64_t* call(const FlatNode& node, uint64_t active, int64_t* out);
+    int64_t runRow(const std::vector<const int64_t*>& args, size_t row);
+};
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef TOY_LANG_MAPPED_FILE
+#define TOY_LANG_MAPPED_FILE
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Read-only memory mapping of a whole file. Empty files open successfully
+// and yield an empty view.
+class MappedFile {
+    const char* data = nullptr;
+    size_t size = 0;
+    bool opened = false;
+#ifdef _WIN32
+    void* file = nullptr;
+    void* mapping = nullptr;
+#endif
+
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+
+    bool isOpen() const { return opened; }
+    std::string_view view() const { return std::string_view(data, size); }
+};
+
+#endif
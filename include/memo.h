@@ -0,0 +1,50 @@
+#ifndef TOY_LANG_MEMO
+#define TOY_LANG_MEMO
+
+#include <cstddef>
+#include <list>
+#include <unordered_map>
+#include <vector>
+#include "value.h"
+
+// Results of pure functions keyed by (function, arguments). Holds at most
+// `capacity` entries and evicts the least recently used one when full.
+// The function key is opaque, so either engine's function objects can be
+// used.
+class MemoCache {
+    struct Key {
+        const void* function;
+        std::vector<Value> args;
+
+        bool operator==(const Key& other) const {
+            return function == other.function && args == other.args;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const;
+    };
+
+    using Entry = std::pair<Key, Value>;
+
+    size_t capacity;
+    std::list<Entry> entries;  // most recently used first
+    std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index;
+    Key probe;
+    size_t hitCount = 0;
+    size_t missCount = 0;
+
+public:
+    explicit MemoCache(size_t capacity);
+
+    bool lookup(const void* function, const Value* args, size_t argc, Value& result);
+    void store(const void* function, const Value* args, size_t argc, Value result);
+    void clear();
+
+    size_t hits() const { return hitCount; }
+    size_t misses() const { return missCount; }
+    size_t size() const { return entries.size(); }
+    size_t getCapacity() const { return capacity; }
+};
+
+#endif
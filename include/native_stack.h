@@ -0,0 +1,21 @@
+#ifndef TOY_LANG_NATIVE_STACK
+#define TOY_LANG_NATIVE_STACK
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+// What a guard on the C++ stack leaves free below itself for the frames
+// that unwind the error it raises.
+constexpr uintptr_t NATIVE_STACK_RESERVE = 256 * 1024;
+
+// The lowest address of the calling thread's stack, looked up once per
+// thread, or 0 where the platform cannot tell.
+uintptr_t nativeStackLow();
+
+// Runs `body` on a new thread with a stack of `bytes`, waiting for it to
+// finish. Returns false, without having run it, if no such thread could be
+// started. `body` must not throw.
+bool runOnNewStack(size_t bytes, const std::function<void()>& body);
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef TOY_LANG_OPTIMIZER
+#define TOY_LANG_OPTIMIZER
+
+#include "visitor.h"
+#include "parser.h"
+
+// Rewrites a resolved program in place: folds operators whose operands are
+// constants, drops identity operations (x + 0, x * 1, ...) and replaces a
+// ternary with a constant condition by the arm it selects. An operation that
+// could fail at runtime, such as division by zero, is never folded away, so
+// errors are still raised where they were.
+class Optimizer : public Visitor {
+    Arena& arena;
+    ExprAST* replacement = nullptr;
+
+public:
+    Optimizer(Arena& arena);
+
+    static void optimize(ProgramAST& program);
+
+    void visit(ExprAST& expr) override;
+    void visit(NumberAST& number) override;
+    void visit(IdentifierAST& identifier) override;
+    void visit(BinaryOpAST& binary) override;
+    void visit(TernaryExprAST& ternary) override;
+    void visit(FunctionCallAST& call) override;
+    void visit(StatementAST& stmt) override;
+    void visit(AssignmentAST& assignment) override;
+    void visit(ReturnStmtAST& returnStmt) override;
+    void visit(FunctionDefAST& functionDef) override;
+
+private:
+    ExprAST* optimize(ExprAST* expr);
+    ExprAST* simplify(BinaryOpAST& binary);
+    NumberAST* makeNumber(const Value& value);
+};
+
+#endif
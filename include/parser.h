@@ -1,12 +1,19 @@
 #ifndef TOY_LANG_PARSER
 #define TOY_LANG_PARSER
 
-#include <memory>
-#include <string>
+#include <cstdint>
+#include <string_view>
 #include <vector>
 #include "visitor.h"
 #include "error.h"
+#include "arena.h"
+#include "symbol.h"
+#include "value.h"
 
+// Nodes are allocated in the Arena owned by their ProgramAST and are never
+// destroyed individually, so they hold only symbols, raw pointers and spans
+// into that arena. Once loaded they are not modified again, so engines
+// refer to function definitions directly instead of copying them.
 class NodeAST {
 public:
   virtual ~NodeAST() = default;
@@ -21,10 +28,16 @@ public:
 };
 
 class NumberAST : public ExprAST {
-  int value;
+  int64_t value = 0;
+  std::string_view digits;
 public:
-  NumberAST(int val) : value(val) {}
-  int getValue() const { return value; }
+  NumberAST(int64_t val) : value(val) {}
+  // A literal beyond 64 bits, by its decimal digits in the arena.
+  NumberAST(std::string_view text) : digits(text) {}
+  bool isBig() const { return !digits.empty(); }
+  std::string_view getDigits() const { return digits; }
+  // Builds a big value anew on each call.
+  Value getValue() const;
   
   void accept(Visitor &visitor) override {
     visitor.visit(*this);
@@ -32,10 +45,18 @@ public:
 };
 
 class IdentifierAST : public ExprAST {
-  std::string name;
+  Symbol name;
+  int depth = -1;
+  int slot = -1;
 public:
-  IdentifierAST(const std::string& id) : name(id) {}
-  const std::string& getName() const { return name; }
+  IdentifierAST(Symbol id) : name(id) {}
+  Symbol getName() const { return name; }
+  
+  // Filled in by the Resolver: how many enclosing functions to walk out and
+  // the slot in that function's frame.
+  int getDepth() const { return depth; }
+  int getSlot() const { return slot; }
+  void setResolved(int d, int s) { depth = d; slot = s; }
   
   void accept(Visitor &visitor) override {
     visitor.visit(*this);
@@ -44,14 +65,15 @@ public:
 
 class BinaryOpAST : public ExprAST {
   char op;
-  std::unique_ptr<ExprAST> left, right;
+  ExprAST *left, *right;
 public:
-  BinaryOpAST(char op, std::unique_ptr<ExprAST> left, std::unique_ptr<ExprAST> right)
-    : op(op), left(std::move(left)), right(std::move(right)) {}
+  BinaryOpAST(char op, ExprAST* left, ExprAST* right)
+    : op(op), left(left), right(right) {}
   
   char getOp() const { return op; }
-  ExprAST* getLeft() const { return left.get(); }
-  ExprAST* getRight() const { return right.get(); }
+  ExprAST* getLeft() const { return left; }
+  ExprAST* getRight() const { return right; }
+  void setOperands(ExprAST* l, ExprAST* r) { left = l; right = r; }
   
   void accept(Visitor &visitor) override {
     visitor.visit(*this);
@@ -59,20 +81,23 @@ public:
 };
 
 class TernaryExprAST : public ExprAST {
-  std::unique_ptr<ExprAST> condition;
-  std::unique_ptr<ExprAST> then_expr;
-  std::unique_ptr<ExprAST> else_expr;
+  ExprAST* condition;
+  ExprAST* then_expr;
+  ExprAST* else_expr;
 public:
-  TernaryExprAST(std::unique_ptr<ExprAST> condition,
-                std::unique_ptr<ExprAST> then_expr,
-                std::unique_ptr<ExprAST> else_expr)
-    : condition(std::move(condition)), 
-      then_expr(std::move(then_expr)),
-      else_expr(std::move(else_expr)) {}
+  TernaryExprAST(ExprAST* condition, ExprAST* then_expr, ExprAST* else_expr)
+    : condition(condition), 
+      then_expr(then_expr),
+      else_expr(else_expr) {}
   
-  ExprAST* getCondition() const { return condition.get(); }
-  ExprAST* getThenExpr() const { return then_expr.get(); }
-  ExprAST* getElseExpr() const { return else_expr.get(); }
+  ExprAST* getCondition() const { return condition; }
+  ExprAST* getThenExpr() const { return then_expr; }
+  ExprAST* getElseExpr() const { return else_expr; }
+  void setArms(ExprAST* c, ExprAST* t, ExprAST* e) {
+    condition = c;
+    then_expr = t;
+    else_expr = e;
+  }
   
   void accept(Visitor &visitor) override {
     visitor.visit(*this);
@@ -80,15 +105,14 @@ public:
 };
 
 class FunctionCallAST : public ExprAST {
-  std::string callee;
-  std::vector<std::unique_ptr<ExprAST>> args;
+  Symbol callee;
+  ArenaSpan<ExprAST*> args;
 public:
-  FunctionCallAST(const std::string& callee, 
-                 std::vector<std::unique_ptr<ExprAST>> args)
-    : callee(callee), args(std::move(args)) {}
+  FunctionCallAST(Symbol callee, ArenaSpan<ExprAST*> args)
+    : callee(callee), args(args) {}
   
-  const std::string& getCallee() const { return callee; }
-  const std::vector<std::unique_ptr<ExprAST>>& getArgs() const { return args; }
+  Symbol getCallee() const { return callee; }
+  const ArenaSpan<ExprAST*>& getArgs() const { return args; }
   
   void accept(Visitor &visitor) override {
     visitor.visit(*this);
@@ -103,14 +127,19 @@ public:
 };
 
 class AssignmentAST : public StatementAST {
-  std::string variable;
-  std::unique_ptr<ExprAST> value;
+  Symbol variable;
+  ExprAST* value;
+  int slot = -1;
 public:
-  AssignmentAST(const std::string& var, std::unique_ptr<ExprAST> val)
-    : variable(var), value(std::move(val)) {}
+  AssignmentAST(Symbol var, ExprAST* val)
+    : variable(var), value(val) {}
+  
+  Symbol getVariable() const { return variable; }
+  ExprAST* getValue() const { return value; }
+  void setValue(ExprAST* val) { value = val; }
   
-  const std::string& getVariable() const { return variable; }
-  ExprAST* getValue() const { return value.get(); }
+  int getSlot() const { return slot; }
+  void setSlot(int s) { slot = s; }
   
   void accept(Visitor &visitor) override {
     visitor.visit(*this);
@@ -118,12 +147,13 @@ public:
 };
 
 class ReturnStmtAST : public StatementAST {
-  std::unique_ptr<ExprAST> return_expr;
+  ExprAST* return_expr;
 public:
-  ReturnStmtAST(std::unique_ptr<ExprAST> expr)
-    : return_expr(std::move(expr)) {}
+  ReturnStmtAST(ExprAST* expr)
+    : return_expr(expr) {}
   
-  ExprAST* getReturnExpr() const { return return_expr.get(); }
+  ExprAST* getReturnExpr() const { return return_expr; }
+  void setReturnExpr(ExprAST* expr) { return_expr = expr; }
   
   void accept(Visitor &visitor) override {
     visitor.visit(*this);
@@ -132,135 +162,92 @@ public:
 
 class FunctionDefAST : public StatementAST { 
 private:
-    std::string name;
-    std::vector<std::string> params;
-    std::vector<std::unique_ptr<StatementAST>> body;
-    std::unique_ptr<ExprAST> return_expr;
+    Symbol name;
+    ArenaSpan<Symbol> params;
+    ArenaSpan<StatementAST*> body;
+    ExprAST* return_expr;
+    size_t frameSize = 0;
+    bool pure = false;
   
 public:
-    FunctionDefAST(const std::string& name, 
-                  std::vector<std::string> params,
-                  std::vector<std::unique_ptr<StatementAST>> body,
-                  std::unique_ptr<ExprAST> return_expr)
-        : name(name), params(std::move(params)), 
-          body(std::move(body)), return_expr(std::move(return_expr)) {}
+    FunctionDefAST(Symbol name, 
+                  ArenaSpan<Symbol> params,
+                  ArenaSpan<StatementAST*> body,
+                  ExprAST* return_expr)
+        : name(name), params(params), 
+          body(body), return_expr(return_expr) {}
     
     FunctionDefAST(const FunctionDefAST&) = delete;
     FunctionDefAST& operator=(const FunctionDefAST&) = delete;
     
-    FunctionDefAST(FunctionDefAST&& other) noexcept 
-        : name(std::move(other.name)),
-          params(std::move(other.params)),
-          body(std::move(other.body)),
-          return_expr(std::move(other.return_expr)) {}
-        
-    FunctionDefAST& operator=(FunctionDefAST&& other) noexcept {
-        if (this != &other) {
-            name = std::move(other.name);
-            params = std::move(other.params);
-            body = std::move(other.body);
-            return_expr = std::move(other.return_expr);
-        }
-        return *this;
-    }
+    Symbol getName() const { return name; }
+    const ArenaSpan<Symbol>& getParams() const { return params; }
+    const ArenaSpan<StatementAST*>& getBody() const { return body; }
+    ExprAST* getReturnExpr() const { return return_expr; }
+    void setReturnExpr(ExprAST* expr) { return_expr = expr; }
+    
+    // Frame size assigned by the Resolver: parameters occupy the first
+    // slots, followed by every assigned local.
+    size_t getFrameSize() const { return frameSize; }
+    void setFrameSize(size_t size) { frameSize = size; }
     
-    const std::string& getName() const { return name; }
-    const std::vector<std::string>& getParams() const { return params; }
-    const std::vector<std::unique_ptr<StatementAST>>& getBody() const { return body; }
-    ExprAST* getReturnExpr() const { return return_expr.get(); }
+    // Set by PurityAnalysis when the result depends only on the arguments.
+    bool isPure() const { return pure; }
+    void setPure(bool p) { pure = p; }
     
     void accept(Visitor &visitor) override {
         visitor.visit(*this);
     }
-    
-    std::unique_ptr<FunctionDefAST> clone() const {
-        std::vector<std::unique_ptr<StatementAST>> cloned_body;
-        cloned_body.reserve(body.size());
-        
-        for (const auto& stmt : body) {
-            if (auto assignment = dynamic_cast<AssignmentAST*>(stmt.get())) {
-                auto cloned_value = cloneExpr(assignment->getValue());
-                cloned_body.push_back(
-                    std::make_unique<AssignmentAST>(
-                        assignment->getVariable(),
-                        std::move(cloned_value)
-                    )
-                );
-            } else if (auto return_stmt = dynamic_cast<ReturnStmtAST*>(stmt.get())) {
-                auto cloned_expr = cloneExpr(return_stmt->getReturnExpr());
-                cloned_body.push_back(
-                    std::make_unique<ReturnStmtAST>(std::move(cloned_expr))
-                );
-            } else if (auto nested_func = dynamic_cast<FunctionDefAST*>(stmt.get())) {
-                cloned_body.push_back(nested_func->clone());
-            }
-        }
-        
-        std::unique_ptr<ExprAST> cloned_return = nullptr;
-        if (return_expr) {
-            cloned_return = cloneExpr(return_expr.get());
-        }
-        
-        return std::make_unique<FunctionDefAST>(
-            name, 
-            params, 
-            std::move(cloned_body),
-            std::move(cloned_return)
-        );
-    }
-    
-private:
-    std::unique_ptr<ExprAST> cloneExpr(ExprAST* expr) const {
-        if (!expr) return nullptr;
-        
-        if (auto number = dynamic_cast<NumberAST*>(expr)) {
-            return std::make_unique<NumberAST>(number->getValue());
-        } else if (auto id = dynamic_cast<IdentifierAST*>(expr)) {
-            return std::make_unique<IdentifierAST>(id->getName());
-        } else if (auto binary = dynamic_cast<BinaryOpAST*>(expr)) {
-            return std::make_unique<BinaryOpAST>(
-                binary->getOp(),
-                cloneExpr(binary->getLeft()),
-                cloneExpr(binary->getRight())
-            );
-        } else if (auto ternary = dynamic_cast<TernaryExprAST*>(expr)) {
-            return std::make_unique<TernaryExprAST>(
-                cloneExpr(ternary->getCondition()),
-                cloneExpr(ternary->getThenExpr()),
-                cloneExpr(ternary->getElseExpr())
-            );
-        } else if (auto call = dynamic_cast<FunctionCallAST*>(expr)) {
-            std::vector<std::unique_ptr<ExprAST>> cloned_args;
-            for (const auto& arg : call->getArgs()) {
-                cloned_args.push_back(cloneExpr(arg.get()));
-            }
-            return std::make_unique<FunctionCallAST>(
-                call->getCallee(),
-                std::move(cloned_args)
-            );
-        }
-        return nullptr;
-    }
+};
+
+// The result of parsing: the top-level functions together with the arena
+// that owns every node reachable from them.
+class ProgramAST {
+    Arena arena;
+    std::vector<FunctionDefAST*> functions;
+
+public:
+    ProgramAST() = default;
+    ProgramAST(ProgramAST&&) = default;
+    ProgramAST& operator=(ProgramAST&&) = default;
+
+    Arena& getArena() { return arena; }
+    const std::vector<FunctionDefAST*>& getFunctions() const { return functions; }
+    void addFunction(FunctionDefAST* func) { functions.push_back(func); }
 };
 
 class Parser {
 private:
     class Tokenizer* tokenizer;
+    Arena* arena = nullptr;
+    
+    // Lists under construction are stacked here and copied into the arena
+    // once complete, so nested lists need no allocations of their own.
+    std::vector<ExprAST*> exprScratch;
+    std::vector<StatementAST*> stmtScratch;
+    std::vector<Symbol> nameScratch;
 
 public:
     Parser(class Tokenizer* tokenizer);
     
-    std::vector<std::unique_ptr<FunctionDefAST>> parseProgram();
+    ProgramAST parseProgram();
     
 private:
-    std::unique_ptr<FunctionDefAST> parseFunctionDef();
-    std::unique_ptr<StatementAST> parseStatement();
-    std::unique_ptr<ExprAST> parseExpression();
-    std::unique_ptr<ExprAST> parseTernaryExpr();
-    std::unique_ptr<ExprAST> parseLogicalExpr();
-    std::unique_ptr<ExprAST> parseAddExpr();
-    std::unique_ptr<ExprAST> parseMulExpr();
-    std::unique_ptr<ExprAST> parsePrimary();
+    FunctionDefAST* parseFunctionDef();
+    StatementAST* parseStatement();
+    ExprAST* parseExpression();
+    ExprAST* parseTernaryExpr();
+    ExprAST* parseLogicalExpr();
+    ExprAST* parseAddExpr();
+    ExprAST* parseMulExpr();
+    ExprAST* parsePrimary();
+    
+    template <typename T>
+    ArenaSpan<T> takeScratch(std::vector<T>& scratch, size_t start) {
+        auto list = copyToArena<T>(*arena, scratch.begin() + start, scratch.end());
+        scratch.resize(start);
+        return list;
+    }
 };
 
 #endif
\ No newline at end of file
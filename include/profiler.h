@@ -0,0 +1,78 @@
+#ifndef TOY_LANG_PROFILER
+#define TOY_LANG_PROFILER
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Wall-clock call profile kept as a calling context tree: one node per
+// distinct chain of callers, holding its call count and inclusive time.
+// Functions are opaque keys, so either engine's function objects can be
+// used. A profiler is not thread-safe; give each thread its own and merge
+// them afterwards.
+class Profiler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Times one call for as long as it is in scope, including when the call
+    // unwinds with an exception.
+    class Call {
+        Profiler& profiler;
+
+    public:
+        Call(Profiler& profiler, const void* function) : profiler(profiler) { profiler.enter(function); }
+        ~Call() { profiler.exit(); }
+
+        Call(const Call&) = delete;
+        Call& operator=(const Call&) = delete;
+    };
+
+    Profiler();
+
+    void enter(const void* function);
+    void exit();
+    // A tail call: the running function is replaced by `function` without
+    // the stack growing.
+    void replace(const void* function);
+
+    void setName(const void* function, std::string name);
+
+    // Adds the calls recorded by `other`, which must not be inside a call.
+    void merge(const Profiler& other);
+
+    // Per-function calls and inclusive and exclusive time, most expensive
+    // exclusive time first. Time spent in recursive calls of a function
+    // counts once towards its inclusive time.
+    void writeTable(std::ostream& out) const;
+    // One "outer;inner;leaf microseconds" line per call chain with
+    // exclusive time, as read by flamegraph.pl and similar tools.
+    void writeCollapsed(std::ostream& out) const;
+
+private:
+    struct Node {
+        const void* function;
+        size_t parent;
+        uint64_t calls = 0;
+        Clock::duration total{};
+        std::vector<size_t> children;
+    };
+
+    struct Active {
+        size_t node;
+        Clock::time_point start;
+    };
+
+    std::vector<Node> nodes;  // nodes[0] is the root and has no function
+    std::vector<Active> active;
+    std::unordered_map<const void*, std::string> names;
+
+    size_t child(size_t parent, const void* function);
+    Clock::duration exclusive(size_t node) const;
+    const std::string& nameOf(const void* function) const;
+    void mergeNode(const Profiler& other, size_t from, size_t into);
+};
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef TOY_LANG_PROGRAM
+#define TOY_LANG_PROGRAM
+
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "parser.h"
+#include "flat_ast.h"
+#include "inliner.h"
+#include "bytecode.h"
+#include "vm.h"
+
+class Environment;
+class JitModule;
+class Tokenizer;
+struct CachedAST;
+
+// A loaded script: the resolved and analyzed AST, the flat copy of it the
+// tree-walker runs, its bytecode and the global scope of each engine.
+// Nothing in it changes once the constructor returns, so one Program can be
+// shared by any number of ExecutionContexts on different threads without
+// locking. The one exception is a program read from a cache file, whose AST
+// is only decoded, once, when first asked for.
+class Program {
+    mutable ProgramAST ast;
+    std::vector<std::unique_ptr<CompiledFunction>> compiled;
+    std::unordered_map<std::string, Symbol> names;
+    std::vector<InlinedCall> inlined;
+    mutable FlatProgram flat;  // built along with globalEnv
+
+    // The engines only look functions up in these.
+    std::unique_ptr<Environment> globalEnv;
+    std::unique_ptr<Frame> globalFrame;
+
+    std::unique_ptr<CachedAST> cachedAST;
+    mutable std::once_flag astDecoded;
+
+    mutable std::unique_ptr<JitModule> jit;
+    mutable std::once_flag jitBuilt;
+
+public:
+    // Optimizing folds constants and inlines calls to functions of at most
+    // `inlineLimit` nodes.
+    Program(std::istream& input, bool optimize = true, size_t inlineLimit = Inliner::DEFAULT_LIMIT);
+    Program(std::string_view source, bool optimize = true, size_t inlineLimit = Inliner::DEFAULT_LIMIT);
+    ~Program();
+
+    Program(const Program&) = delete;
+    Program& operator=(const Program&) = delete;
+
+    // Loads `source` from the cache file at `cachePath` when that was built
+    // from the same source with the same options. Otherwise parses it and
+    // rewrites the cache; failing to write the cache is not an error.
+    static std::shared_ptr<const Program> loadCached(std::string_view source, const std::string& cachePath,
+                                                     bool optimize = true,
+                                                     size_t inlineLimit = Inliner::DEFAULT_LIMIT);
+
+    // Finds a top-level function name without going through the shared
+    // symbol table and its lock.
+    bool lookup(std::string_view name, Symbol& symbol) const;
+
+    Environment& getGlobalEnvironment() const {
+        requireAST();
+        return *globalEnv;
+    }
+    Frame& getGlobalFrame() const { return *globalFrame; }
+
+    const std::vector<FunctionDefAST*>& getFunctions() const {
+        requireAST();
+        return ast.getFunctions();
+    }
+    // The functions as the tree-walker runs them, in the same order.
+    const FlatProgram& getFlatProgram() const {
+        requireAST();
+        return flat;
+    }
+    const std::vector<std::unique_ptr<CompiledFunction>>& getCompiled() const { return compiled; }
+    // What the inliner did while loading; empty for a program read from a
+    // cache file.
+    const std::vector<InlinedCall>& getInlinedCalls() const { return inlined; }
+
+    // Native code for the functions that can have it, generated, once, when
+    // first asked for.
+    const JitModule& getJit() const;
+
+private:
+    friend class ProgramCache;
+
+    Program();
+
+    void load(Tokenizer& tokenizer, bool optimize, size_t inlineLimit);
+    void defineGlobals();
+    void defineTreeGlobals() const;
+    void requireAST() const;
+};
+
+#endif
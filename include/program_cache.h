@@ -0,0 +1,48 @@
+#ifndef TOY_LANG_PROGRAM_CACHE
+#define TOY_LANG_PROGRAM_CACHE
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "mapped_file.h"
+#include "symbol.h"
+
+class Program;
+class ProgramAST;
+
+// The AST section of a cache file, left mapped and undecoded until the
+// tree-walker first needs it. The bytecode engine never does.
+struct CachedAST {
+    MappedFile file;
+    std::string_view section;
+    size_t functionCount = 0;
+    std::vector<Symbol> strings;
+};
+
+// Binary snapshot of a loaded Program (the resolved and analyzed AST plus
+// its bytecode) so that later runs can skip tokenizing, parsing, analysis
+// and compilation. A cache file records a hash of the source it was built
+// from and the load options; a file that does not match, or fails its
+// checksum or structural checks, is rejected and the caller falls back to
+// the source.
+class ProgramCache {
+public:
+    static uint64_t hashSource(std::string_view source);
+
+    // Fills `program` from the cache at `path`. Returns false, leaving the
+    // program untouched, if the file is missing, stale or corrupt.
+    static bool read(const std::string& path, std::string_view source, bool optimize, size_t inlineLimit,
+                     Program& program);
+
+    // Decodes the AST section kept by read(). Throws RuntimeError if it
+    // fails its structural checks.
+    static void readAST(const CachedAST& cached, ProgramAST& ast);
+
+    // Writes the cache through a temporary file that replaces `path` only
+    // once complete. Returns false if it could not be written.
+    static bool write(const std::string& path, std::string_view source, bool optimize, size_t inlineLimit,
+                      const Program& program);
+};
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef TOY_LANG_PURITY
+#define TOY_LANG_PURITY
+
+#include <set>
+#include <vector>
+#include "visitor.h"
+#include "parser.h"
+
+// Marks the functions whose result depends only on their arguments, which
+// makes their calls safe to memoize. A function is pure when nothing in it,
+// nested functions included, reads a variable from outside it, and every
+// call it makes reaches a pure top-level function. Function lookup is
+// dynamic, so a call only counts as reaching a top-level function when no
+// nested def anywhere in the program uses the same name.
+class PurityAnalysis : public Visitor {
+    struct Summary {
+        FunctionDefAST* function;
+        bool readsOuter = false;
+        std::set<Symbol> calls;
+    };
+
+    std::vector<Summary> summaries;
+    std::vector<size_t> open;  // functions enclosing the current node, outermost first
+    std::set<Symbol> nestedNames;
+
+public:
+    static void analyze(ProgramAST& program);
+
+    void visit(ExprAST& expr) override;
+    void visit(NumberAST& number) override;
+    void visit(IdentifierAST& identifier) override;
+    void visit(BinaryOpAST& binary) override;
+    void visit(TernaryExprAST& ternary) override;
+    void visit(FunctionCallAST& call) override;
+    void visit(StatementAST& stmt) override;
+    void visit(AssignmentAST& assignment) override;
+    void visit(ReturnStmtAST& returnStmt) override;
+    void visit(FunctionDefAST& functionDef) override;
+};
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef TOY_LANG_RESOLVER
+#define TOY_LANG_RESOLVER
+
+#include <map>
+#include <set>
+#include "visitor.h"
+#include "parser.h"
+
+// Assigns every parameter and local of a function a frame slot and binds each
+// IdentifierAST to a (depth, slot) pair, where depth counts lexically
+// enclosing functions. Function bodies are straight-line code, so a read
+// refers to the local slot only once an earlier statement has assigned it;
+// before that it refers to the enclosing function, as it did at runtime.
+// The same holds for a nested function: it sees what its definer had
+// assigned before the def, unless every call to it comes after a later
+// assignment. A read that would refer to different variables depending on
+// when the function is called is a NameError.
+class Resolver : public Visitor {
+    struct Scope {
+        FunctionDefAST* function;
+        Scope* enclosing;
+        std::map<Symbol, int> slots;
+        std::set<Symbol> bound;
+        size_t position = 0;  // the statement being resolved
+    };
+
+    // When a nested function may run relative to an assignment in its
+    // definer.
+    enum Timing { NEVER = 0, BEFORE = 1, AFTER = 2 };
+
+    const ProgramAST* program = nullptr;
+    Scope* scope = nullptr;
+
+public:
+    void resolve(ProgramAST& program);
+
+    void visit(ExprAST& expr) override;
+    void visit(NumberAST& number) override;
+    void visit(IdentifierAST& identifier) override;
+    void visit(BinaryOpAST& binary) override;
+    void visit(TernaryExprAST& ternary) override;
+    void visit(FunctionCallAST& call) override;
+    void visit(StatementAST& stmt) override;
+    void visit(AssignmentAST& assignment) override;
+    void visit(ReturnStmtAST& returnStmt) override;
+    void visit(FunctionDefAST& functionDef) override;
+
+private:
+    void resolveFunction(FunctionDefAST& functionDef);
+    int whenCalled(const Scope& definer, const FunctionDefAST& nested, Symbol name) const;
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef TOY_LANG_SERVER
+#define TOY_LANG_SERVER
+
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include "interpreter.h"
+#include "program.h"
+
+// Answers call requests against one loaded Program.
+//
+// The protocol is line based. A request is a function name followed by its
+// integer arguments, separated by whitespace. Each request gets exactly one
+// reply line, "OK <value>" or "ERR <message>". Replies come back in request
+// order, so a client may send any number of requests before reading.
+class Server {
+    std::shared_ptr<const Program> program;
+    Engine engine;
+    size_t memoCapacity = 0;
+    RunLimits limits;
+    size_t stackLimit = VirtualMachine::DEFAULT_STACK_LIMIT;
+
+public:
+    Server(std::shared_ptr<const Program> program, Engine engine = Engine::Bytecode);
+
+    // Gives every connection a memo cache of this many entries.
+    void enableMemoization(size_t capacity) { memoCapacity = capacity; }
+    // Applies `limits` to every request.
+    void setLimits(const RunLimits& runLimits) { limits = runLimits; }
+    void setStackLimit(size_t bytes) { stackLimit = bytes; }
+
+    // Serves a single client until its input ends.
+    void serve(std::istream& in, std::ostream& out);
+
+    // Listens on a Unix domain socket and serves each connection on its own
+    // thread with its own ExecutionContext. Replaces a stale socket at
+    // `path` but refuses any other kind of file. Only returns by throwing.
+    void serveSocket(const std::string& path);
+
+    std::string handle(ExecutionContext& context, std::string_view request);
+
+private:
+    std::unique_ptr<ExecutionContext> createContext();
+    void serveConnection(int fd);
+};
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef TOY_LANG_STATS
+#define TOY_LANG_STATS
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include "bytecode.h"
+
+// Counts of what the engines did, for finding out why a script is slow.
+// Counting is compiled in only when TOY_STATS is defined (the CMake option
+// of the same name); without it every TOY_STAT expands to nothing and the
+// counters stay zero.
+struct RuntimeStats {
+    enum Node { NUMBER, IDENTIFIER, BINARY_OP, TERNARY, CALL, ASSIGNMENT, RETURN, FUNCTION_DEF, NODE_KINDS };
+    static constexpr size_t OPCODES = static_cast<size_t>(OpCode::RETURN) + 1;
+
+#ifdef TOY_STATS
+    static constexpr bool enabled = true;
+#else
+    static constexpr bool enabled = false;
+#endif
+
+    // Tree-walker
+    uint64_t nodes[NODE_KINDS] = {};
+    uint64_t environments = 0;
+    uint64_t evaluators = 0;
+
+    // Bytecode VM
+    uint64_t instructions[OPCODES] = {};
+    uint64_t frames = 0;
+
+    // Both engines
+    uint64_t variableLookups = 0;
+    uint64_t variableHops = 0;     // enclosing frames walked to reach a variable
+    uint64_t functionLookups = 0;
+    uint64_t functionHops = 0;     // caller frames walked to find a function
+    uint64_t slotsAllocated = 0;   // Values set aside for new frames
+    uint64_t tailCalls = 0;        // calls that reused their caller's frame
+    size_t depth = 0;
+    size_t peakDepth = 0;          // deepest nesting of frames
+
+    void merge(const RuntimeStats& other);
+    void write(std::ostream& out) const;
+
+    // The counters the running thread adds to: those of the innermost
+    // Scope, or a private set outside of any.
+    static RuntimeStats& current() {
+        RuntimeStats* stats = active;
+        return stats ? *stats : unscoped();
+    }
+
+    class Scope {
+        RuntimeStats* previous;
+
+    public:
+        explicit Scope(RuntimeStats& stats) : previous(active) { active = &stats; }
+        ~Scope() { active = previous; }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
+    // Tracks frame nesting for peakDepth.
+    static void pushFrame() {
+        RuntimeStats& stats = current();
+        if (++stats.depth > stats.peakDepth) {
+            stats.peakDepth = stats.depth;
+        }
+    }
+    static void popFrames(size_t count) { current().depth -= count; }
+
+    // Nesting for as long as a C++ frame is.
+    class Nesting {
+    public:
+        Nesting() { pushFrame(); }
+        ~Nesting() { popFrames(1); }
+
+        Nesting(const Nesting&) = delete;
+        Nesting& operator=(const Nesting&) = delete;
+    };
+
+private:
+    static thread_local RuntimeStats* active;
+    static RuntimeStats& unscoped();
+};
+
+#ifdef TOY_STATS
+#define TOY_STAT(expr) ((void)(RuntimeStats::current().expr))
+#define TOY_STAT_NESTING() RuntimeStats::Nesting statNesting_
+#define TOY_STAT_PUSH_FRAME() RuntimeStats::pushFrame()
+#define TOY_STAT_POP_FRAMES(count) RuntimeStats::popFrames(count)
+#else
+#define TOY_STAT(expr) ((void)0)
+#define TOY_STAT_NESTING() ((void)0)
+#define TOY_STAT_PUSH_FRAME() ((void)0)
+#define TOY_STAT_POP_FRAMES(count) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef TOY_LANG_SYMBOL
+#define TOY_LANG_SYMBOL
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Interned identifier. Equal names always map to the same id, so names can
+// be compared and used as keys as plain integers.
+using Symbol = uint32_t;
+
+// Keywords are interned first, in this order, so the tokenizer can tell them
+// apart from identifiers by id alone.
+namespace Keywords {
+constexpr Symbol DEF = 0;
+constexpr Symbol RETURN = 1;
+constexpr Symbol IF = 2;
+constexpr Symbol THEN = 3;
+constexpr Symbol ELSE = 4;
+constexpr Symbol COUNT = 5;
+}
+
+class SymbolTable {
+    mutable std::mutex mutex;
+    std::unordered_map<std::string_view, Symbol> index;
+    std::deque<std::string> names;
+
+    SymbolTable();
+
+public:
+    static SymbolTable& global();
+
+    Symbol intern(std::string_view name);
+    // Makes room for `count` more names, for callers about to intern many.
+    void reserve(size_t count);
+    bool lookup(std::string_view name, Symbol& symbol) const;
+    std::string name(Symbol symbol) const;
+};
+
+inline std::string symbolName(Symbol symbol) {
+    return SymbolTable::global().name(symbol);
+}
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef TOY_LANG_THREAD_POOL
+#define TOY_LANG_THREAD_POOL
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads that run index ranges of a parallel loop.
+// Each worker owns a deque of ranges: it takes work from the front of its own
+// deque and, once that is empty, steals from the back of the others, so
+// uneven items still keep every thread busy.
+class ThreadPool {
+public:
+    // Called with the index of the worker running it and a half-open range.
+    using RangeTask = std::function<void(size_t worker, size_t begin, size_t end)>;
+
+private:
+    struct Range {
+        size_t begin;
+        size_t end;
+    };
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Range> ranges;
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const RangeTask* task = nullptr;
+    size_t generation = 0;
+    size_t busy = 0;
+    bool stopping = false;
+    std::exception_ptr failure;
+
+public:
+    // A count of zero uses one thread per hardware thread.
+    explicit ThreadPool(size_t threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return workers.size(); }
+
+    // Runs `body` over [0, count) split into ranges of about `grain` items
+    // and returns once all of them are done. The first exception thrown by
+    // `body` is rethrown here after the loop has drained. Only one loop may
+    // run on a pool at a time.
+    void parallelFor(size_t count, size_t grain, const RangeTask& body);
+
+private:
+    void workerLoop(size_t index);
+    bool takeRange(size_t index, Range& range);
+};
+
+#endif
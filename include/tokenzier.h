@@ -1,16 +1,22 @@
 #ifndef TOY_LANG_TOKENIZER
 #define TOY_LANG_TOKENIZER
 
+#include <cstdint>
 #include <istream>
 #include <string>
+#include <string_view>
 #include <variant>
+#include "symbol.h"
 
 struct SymbolToken {
-  std::string name;
+  Symbol symbol;
 };
 
+// A literal too large for 64 bits keeps its digits, which point into the
+// tokenizer's buffer, and leaves `value` at 0.
 struct ConstantToken {
-  int value;
+  int64_t value;
+  std::string_view digits;
 };
 
 
@@ -35,15 +41,24 @@ using Token = std::variant<SymbolToken, ConstantToken, EmbracingToken,
 
 class Tokenizer {
 private:
-  std::istream* in_;
+  std::string buffer_;
+  const char* pos_;
+  const char* end_;
   Token current_token_;
 
   void SkipWhitespace();
   Token ReadNumber();
-  std::string ReadIdentifier();
+  std::string_view ReadIdentifier();
 
 public:
+  // Reads the whole stream into an owned buffer.
   Tokenizer(std::istream *in);
+  // Tokenizes a contiguous buffer in place; it must outlive the tokenizer
+  // and every token it produces.
+  Tokenizer(std::string_view source);
+
+  Tokenizer(const Tokenizer&) = delete;
+  Tokenizer& operator=(const Tokenizer&) = delete;
 
   bool IsEnd();
 
@@ -0,0 +1,206 @@
+#ifndef TOY_LANG_VALUE
+#define TOY_LANG_VALUE
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+class BigInt;
+
+// A small tagged value that is passed and stored by value. Integers that
+// fit in 64 bits are held inline; arithmetic on them is checked, and only a
+// result that overflows is promoted to a BigInt on the heap. Big values are
+// immutable and shared by reference count between copies, so copying a
+// Value never allocates, and neither does anything on the inline path.
+class Value {
+public:
+    enum class Type : uint8_t { Nil, Int, Big };
+
+private:
+    struct Boxed;
+
+    union {
+        int64_t intValue;
+        Boxed* bigValue;
+    };
+    Type type;
+
+public:
+    constexpr Value() : intValue(0), type(Type::Nil) {}
+    constexpr explicit Value(int64_t val) : intValue(val), type(Type::Int) {}
+    // Held inline if it fits, so that a value has only one representation.
+    explicit Value(BigInt val);
+
+    Value(const Value& other) : type(other.type) {
+        if (type == Type::Big) {
+            bigValue = other.bigValue;
+            retain(bigValue);
+        } else {
+            intValue = other.intValue;
+        }
+    }
+    Value(Value&& other) noexcept : type(other.type) {
+        if (type == Type::Big) {
+            bigValue = other.bigValue;
+            other.type = Type::Nil;
+            other.intValue = 0;
+        } else {
+            intValue = other.intValue;
+        }
+    }
+    Value& operator=(const Value& other) {
+        if (other.type == Type::Big) {
+            retain(other.bigValue);
+        }
+        if (type == Type::Big) {
+            release(bigValue);
+        }
+        type = other.type;
+        if (type == Type::Big) {
+            bigValue = other.bigValue;
+        } else {
+            intValue = other.intValue;
+        }
+        return *this;
+    }
+    Value& operator=(Value&& other) noexcept {
+        if (this != &other) {
+            if (type == Type::Big) {
+                release(bigValue);
+            }
+            type = other.type;
+            if (type == Type::Big) {
+                bigValue = other.bigValue;
+                other.type = Type::Nil;
+                other.intValue = 0;
+            } else {
+                intValue = other.intValue;
+            }
+        }
+        return *this;
+    }
+    ~Value() {
+        if (type == Type::Big) {
+            release(bigValue);
+        }
+    }
+
+    // Decimal digits with an optional '-', of any length; false if `text`
+    // is not a number.
+    static bool parse(std::string_view text, Value& result);
+
+    constexpr Type getType() const { return type; }
+    constexpr bool isNil() const { return type == Type::Nil; }
+    constexpr bool isBig() const { return type == Type::Big; }
+    // Only meaningful when the value is not big; Nil reads as 0.
+    constexpr int64_t asInt() const { return intValue; }
+    const BigInt& asBig() const;
+    BigInt toBig() const;
+    constexpr bool isZero() const { return type != Type::Big && intValue == 0; }
+
+    std::string toString() const;
+    size_t hash() const;
+
+    // The language's operators. Division by zero is for the engines to
+    // report, so divide must not be called with a zero divisor.
+    static Value add(const Value& left, const Value& right) {
+        int64_t result;
+        if (bothInline(left, right) && checkedAdd(left.intValue, right.intValue, result)) {
+            return Value(result);
+        }
+        return addBig(left, right);
+    }
+    static Value subtract(const Value& left, const Value& right) {
+        int64_t result;
+        if (bothInline(left, right) && checkedSubtract(left.intValue, right.intValue, result)) {
+            return Value(result);
+        }
+        return subtractBig(left, right);
+    }
+    static Value multiply(const Value& left, const Value& right) {
+        int64_t result;
+        if (bothInline(left, right) && checkedMultiply(left.intValue, right.intValue, result)) {
+            return Value(result);
+        }
+        return multiplyBig(left, right);
+    }
+    static Value divide(const Value& left, const Value& right) {
+        if (bothInline(left, right) && !(right.intValue == -1 && left.intValue == INT64_MIN)) {
+            return Value(left.intValue / right.intValue);
+        }
+        return divideBig(left, right);
+    }
+    static bool equal(const Value& left, const Value& right) {
+        if (bothInline(left, right)) {
+            return left.intValue == right.intValue;
+        }
+        return equalBig(left, right);
+    }
+    static bool less(const Value& left, const Value& right) {
+        if (bothInline(left, right)) {
+            return left.intValue < right.intValue;
+        }
+        return lessBig(left, right);
+    }
+
+    // Identity rather than the language's `==`: Nil only equals Nil.
+    bool operator==(const Value& other) const;
+    bool operator!=(const Value& other) const { return !(*this == other); }
+
+    // 64-bit arithmetic that returns false instead of overflowing.
+    static bool checkedAdd(int64_t left, int64_t right, int64_t& result) {
+#if defined(__GNUC__) || defined(__clang__)
+        return !__builtin_add_overflow(left, right, &result);
+#else
+        if ((right > 0 && left > INT64_MAX - right) || (right < 0 && left < INT64_MIN - right)) {
+            return false;
+        }
+        result = left + right;
+        return true;
+#endif
+    }
+    static bool checkedSubtract(int64_t left, int64_t right, int64_t& result) {
+#if defined(__GNUC__) || defined(__clang__)
+        return !__builtin_sub_overflow(left, right, &result);
+#else
+        if ((right < 0 && left > INT64_MAX + right) || (right > 0 && left < INT64_MIN + right)) {
+            return false;
+        }
+        result = left - right;
+        return true;
+#endif
+    }
+    static bool checkedMultiply(int64_t left, int64_t right, int64_t& result) {
+#if defined(__GNUC__) || defined(__clang__)
+        return !__builtin_mul_overflow(left, right, &result);
+#else
+        bool overflows = left > 0 ? (right > 0 ? left > INT64_MAX / right : right < INT64_MIN / left)
+                                  : (right > 0 ? left < INT64_MIN / right : left != 0 && right < INT64_MAX / left);
+        if (overflows) {
+            return false;
+        }
+        result = left * right;
+        return true;
+#endif
+    }
+
+private:
+    static bool bothInline(const Value& left, const Value& right) {
+        return left.type != Type::Big && right.type != Type::Big;
+    }
+
+    static void retain(Boxed* boxed);
+    static void release(Boxed* boxed);
+
+    static Value addBig(const Value& left, const Value& right);
+    static Value subtractBig(const Value& left, const Value& right);
+    static Value multiplyBig(const Value& left, const Value& right);
+    static Value divideBig(const Value& left, const Value& right);
+    static bool equalBig(const Value& left, const Value& right);
+    static bool lessBig(const Value& left, const Value& right);
+};
+
+static_assert(sizeof(Value) <= 16, "Value must stay two words");
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef TOY_LANG_VM
+#define TOY_LANG_VM
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+#include "budget.h"
+#include "bytecode.h"
+#include "memo.h"
+#include "profiler.h"
+#include "value.h"
+
+class JitModule;
+
+// A frame's slots live contiguously on the value stack starting at `base`.
+// Variables are reached through the lexical `enclosing` chain, functions
+// through the dynamic `parent` chain. Few frames define functions, so the
+// table of those is only allocated by the first definition, and `parent`
+// skips callers that had defined none: a caller is suspended until its
+// callee returns, so it cannot define any in between, and lookups stay
+// short however deep the recursion.
+struct Frame {
+    using Functions = std::map<Symbol, const CompiledFunction*>;
+
+    const CompiledFunction* function;
+    Frame* parent;
+    Frame* enclosing;
+    size_t base;
+    uint32_t ip = 0;         // where the frame resumes once its callee returns
+    bool memoized = false;   // stores its result under the key on top of memoKeys
+    bool profiled = false;
+    std::unique_ptr<Functions> functions;
+
+    Frame(const CompiledFunction* function, Frame* parent, Frame* enclosing, size_t base);
+
+    void defineFunction(const CompiledFunction* nested);
+    bool definesFunctions() const { return functions != nullptr; }
+    const CompiledFunction* findFunction(Symbol name, Frame** scope);
+};
+
+struct PendingCall {
+    const CompiledFunction* function;
+    Frame* scope;
+};
+
+// Holds the mutable state of bytecode execution. The global frame belongs
+// to the Program and is only read, so several machines may share it.
+//
+// Calls do not recurse in C++: the frames of a run are kept on `frames`,
+// a deque so that they stay put as it grows, and a call or a return only
+// switches the frame the dispatch loop runs. How deep a script may recurse
+// is therefore set by the stack limit, not by the thread's stack.
+class VirtualMachine {
+public:
+    static constexpr size_t DEFAULT_STACK_LIMIT = size_t(256) << 20;
+
+private:
+    struct MemoKey {
+        const CompiledFunction* function;
+        std::vector<Value> args;
+    };
+
+    Frame& globals;
+    std::vector<Value> stack;
+    std::deque<Frame> frames;
+    std::vector<PendingCall> callees;
+    // Arguments of the memoized calls in progress, copied before the call
+    // since parameters may be reassigned.
+    std::vector<MemoKey> memoKeys;
+    size_t stackLimit = DEFAULT_STACK_LIMIT;
+    MemoCache* memo = nullptr;
+    Profiler* profiler = nullptr;
+    const JitModule* jit = nullptr;
+    CallBudget* budget;
+    // Functions whose native code overflowed a value or the native stack
+    // during this run. The VM runs them itself from then on, rather than
+    // retrying natively at every depth of a recursion that keeps
+    // overflowing.
+    std::unordered_set<const CompiledFunction*> overflowed;
+
+public:
+    // Every call is charged to `budget`, which the caller starts before
+    // each run.
+    VirtualMachine(Frame& globals, CallBudget& budget);
+
+    // Calls to pure functions are looked up in and stored to `cache` when
+    // set; pass nullptr to turn memoization off.
+    void setMemoCache(MemoCache* cache) { memo = cache; }
+    // Records every call in `profile` when set. When not, profiling costs
+    // one branch per call.
+    void setProfiler(Profiler* profile) { profiler = profile; }
+    // Runs functions that have native code in `module` natively when set,
+    // as long as their values fit in 64 bits. Native code neither memoizes
+    // nor profiles.
+    void setJit(const JitModule* module) { jit = module; }
+    // Bytes the frames and values of a run may take before it fails with
+    // a LimitError.
+    void setStackLimit(size_t bytes) { stackLimit = bytes; }
+    size_t getStackLimit() const { return stackLimit; }
+
+    Value run(Symbol name, const std::vector<Value>& args);
+
+private:
+    Value start(const CompiledFunction* function, Frame* scope, const std::vector<Value>& args);
+    Value execute();
+    bool enter(Frame& caller, size_t argc);
+    void pushFrame(const PendingCall& pending, Frame& caller, size_t base);
+    [[noreturn]] void stackOverflow() const;
+    bool leave(Value& result);
+    void unwind();
+    bool callNative(const CompiledFunction* function, const Value* args, size_t argc, Value& result);
+    Value pop();
+};
+
+#endif
@@ -0,0 +1,60 @@
+#include "arena.h"
+#include <cstdint>
+#include <cstring>
+
+Arena::Arena(size_t blockSize) : blockSize(blockSize) {}
+
+Arena::Arena(Arena&& other) noexcept
+    : blocks(std::move(other.blocks)),
+      cursor(other.cursor),
+      limit(other.limit),
+      blockSize(other.blockSize),
+      used(other.used) {
+    other.cursor = nullptr;
+    other.limit = nullptr;
+    other.used = 0;
+}
+
+Arena& Arena::operator=(Arena&& other) noexcept {
+    if (this != &other) {
+        blocks = std::move(other.blocks);
+        cursor = other.cursor;
+        limit = other.limit;
+        blockSize = other.blockSize;
+        used = other.used;
+        other.cursor = nullptr;
+        other.limit = nullptr;
+        other.used = 0;
+    }
+    return *this;
+}
+
+void* Arena::allocate(size_t size, size_t align) {
+    size_t padding = (align - reinterpret_cast<uintptr_t>(cursor) % align) % align;
+
+    if (!cursor || static_cast<size_t>(limit - cursor) < size + padding) {
+        grow(size + align);
+        padding = (align - reinterpret_cast<uintptr_t>(cursor) % align) % align;
+    }
+
+    char* result = cursor + padding;
+    cursor = result + size;
+    used += size + padding;
+    return result;
+}
+
+std::string_view Arena::copyString(std::string_view text) {
+    if (text.empty()) {
+        return std::string_view();
+    }
+    char* data = static_cast<char*>(allocate(text.size(), 1));
+    std::memcpy(data, text.data(), text.size());
+    return std::string_view(data, text.size());
+}
+
+void Arena::grow(size_t minimum) {
+    size_t size = minimum > blockSize ? minimum : blockSize;
+    blocks.push_back(std::unique_ptr<char[]>(new char[size]));
+    cursor = blocks.back().get();
+    limit = cursor + size;
+}
@@ -0,0 +1,367 @@
+#include "bigint.h"
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+using Limbs = std::vector<uint32_t>;
+
+constexpr uint64_t BASE = uint64_t(1) << 32;
+
+// Below this many limbs in the shorter operand, the schoolbook product is
+// faster than splitting it up.
+constexpr size_t KARATSUBA_THRESHOLD = 32;
+
+// Decimal digits handled per limb operation when converting to and from
+// text.
+constexpr int CHUNK_DIGITS = 9;
+constexpr uint32_t CHUNK = 1000000000;
+
+void trim(Limbs& limbs) {
+    while (!limbs.empty() && limbs.back() == 0) {
+        limbs.pop_back();
+    }
+}
+
+int compareMagnitudes(const Limbs& left, const Limbs& right) {
+    if (left.size() != right.size()) {
+        return left.size() < right.size() ? -1 : 1;
+    }
+    for (size_t i = left.size(); i-- > 0;) {
+        if (left[i] != right[i]) {
+            return left[i] < right[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+Limbs addMagnitudes(const uint32_t* a, size_t an, const uint32_t* b, size_t bn) {
+    if (an < bn) {
+        std::swap(a, b);
+        std::swap(an, bn);
+    }
+    Limbs sum(an + 1);
+    uint64_t carry = 0;
+    for (size_t i = 0; i < an; i++) {
+        uint64_t digit = uint64_t(a[i]) + (i < bn ? b[i] : 0) + carry;
+        sum[i] = static_cast<uint32_t>(digit);
+        carry = digit >> 32;
+    }
+    sum[an] = static_cast<uint32_t>(carry);
+    trim(sum);
+    return sum;
+}
+
+// a -= b, where a is at least b.
+void subtractInPlace(Limbs& a, const uint32_t* b, size_t bn) {
+    uint64_t borrow = 0;
+    for (size_t i = 0; i < a.size() && (i < bn || borrow); i++) {
+        uint64_t digit = uint64_t(a[i]) - (i < bn ? b[i] : 0) - borrow;
+        a[i] = static_cast<uint32_t>(digit);
+        borrow = digit >> 63;
+    }
+    trim(a);
+}
+
+// target += value * BASE^shift; target is long enough for the sum.
+void addShifted(Limbs& target, const Limbs& value, size_t shift) {
+    uint64_t carry = 0;
+    size_t i = 0;
+    for (; i < value.size(); i++) {
+        uint64_t digit = uint64_t(target[shift + i]) + value[i] + carry;
+        target[shift + i] = static_cast<uint32_t>(digit);
+        carry = digit >> 32;
+    }
+    for (size_t at = shift + i; carry && at < target.size(); at++) {
+        uint64_t digit = uint64_t(target[at]) + carry;
+        target[at] = static_cast<uint32_t>(digit);
+        carry = digit >> 32;
+    }
+}
+
+Limbs schoolbook(const uint32_t* a, size_t an, const uint32_t* b, size_t bn) {
+    Limbs product(an + bn);
+    for (size_t i = 0; i < an; i++) {
+        uint64_t carry = 0;
+        for (size_t j = 0; j < bn; j++) {
+            uint64_t digit = uint64_t(a[i]) * b[j] + product[i + j] + carry;
+            product[i + j] = static_cast<uint32_t>(digit);
+            carry = digit >> 32;
+        }
+        product[i + bn] = static_cast<uint32_t>(carry);
+    }
+    trim(product);
+    return product;
+}
+
+// Karatsuba: with a = a1 * B + a0 and b = b1 * B + b0, the middle term
+// a1 * b0 + a0 * b1 is (a0 + a1)(b0 + b1) - a0 * b0 - a1 * b1, which takes
+// three half-size products instead of four.
+Limbs multiplyMagnitudes(const uint32_t* a, size_t an, const uint32_t* b, size_t bn) {
+    while (an > 0 && a[an - 1] == 0) {
+        an--;
+    }
+    while (bn > 0 && b[bn - 1] == 0) {
+        bn--;
+    }
+    if (an < bn) {
+        std::swap(a, b);
+        std::swap(an, bn);
+    }
+    if (bn == 0) {
+        return Limbs();
+    }
+    if (bn < KARATSUBA_THRESHOLD) {
+        return schoolbook(a, an, b, bn);
+    }
+
+    size_t half = an / 2;
+    Limbs product(an + bn + 1);
+
+    // A much shorter b is multiplied with each half of a on its own.
+    if (bn <= half) {
+        addShifted(product, multiplyMagnitudes(a, half, b, bn), 0);
+        addShifted(product, multiplyMagnitudes(a + half, an - half, b, bn), half);
+        trim(product);
+        return product;
+    }
+
+    Limbs low = multiplyMagnitudes(a, half, b, half);
+    Limbs high = multiplyMagnitudes(a + half, an - half, b + half, bn - half);
+    Limbs aSum = addMagnitudes(a, half, a + half, an - half);
+    Limbs bSum = addMagnitudes(b, half, b + half, bn - half);
+    Limbs middle = multiplyMagnitudes(aSum.data(), aSum.size(), bSum.data(), bSum.size());
+    subtractInPlace(middle, low.data(), low.size());
+    subtractInPlace(middle, high.data(), high.size());
+
+    addShifted(product, low, 0);
+    addShifted(product, middle, half);
+    addShifted(product, high, 2 * half);
+    trim(product);
+    return product;
+}
+
+// The remainder of dividing `limbs` by `divisor` in place.
+uint32_t divideSmall(Limbs& limbs, uint32_t divisor) {
+    uint64_t remainder = 0;
+    for (size_t i = limbs.size(); i-- > 0;) {
+        uint64_t current = (remainder << 32) | limbs[i];
+        limbs[i] = static_cast<uint32_t>(current / divisor);
+        remainder = current % divisor;
+    }
+    trim(limbs);
+    return static_cast<uint32_t>(remainder);
+}
+
+void multiplySmallAdd(Limbs& limbs, uint32_t factor, uint32_t addend) {
+    uint64_t carry = addend;
+    for (uint32_t& limb : limbs) {
+        uint64_t digit = uint64_t(limb) * factor + carry;
+        limb = static_cast<uint32_t>(digit);
+        carry = digit >> 32;
+    }
+    if (carry) {
+        limbs.push_back(static_cast<uint32_t>(carry));
+    }
+}
+
+// Long division, Knuth's algorithm D: the divisor is shifted until its top
+// bit is set, which keeps each estimated quotient limb at most two too
+// large.
+Limbs divideMagnitudes(const Limbs& dividend, const Limbs& divisor) {
+    if (compareMagnitudes(dividend, divisor) < 0) {
+        return Limbs();
+    }
+    if (divisor.size() == 1) {
+        Limbs quotient = dividend;
+        divideSmall(quotient, divisor[0]);
+        return quotient;
+    }
+
+    size_t n = divisor.size();
+    size_t m = dividend.size() - n;
+    int shift = 0;
+    while ((divisor.back() << shift & 0x80000000u) == 0) {
+        shift++;
+    }
+
+    Limbs v(n);
+    Limbs u(dividend.size() + 1);
+    for (size_t i = n; i-- > 0;) {
+        v[i] = divisor[i] << shift | (shift && i > 0 ? divisor[i - 1] >> (32 - shift) : 0);
+    }
+    u[dividend.size()] = shift ? dividend.back() >> (32 - shift) : 0;
+    for (size_t i = dividend.size(); i-- > 0;) {
+        u[i] = dividend[i] << shift | (shift && i > 0 ? dividend[i - 1] >> (32 - shift) : 0);
+    }
+
+    Limbs quotient(m + 1);
+    for (size_t j = m + 1; j-- > 0;) {
+        uint64_t numerator = uint64_t(u[j + n]) << 32 | u[j + n - 1];
+        uint64_t estimate = numerator / v[n - 1];
+        uint64_t rest = numerator % v[n - 1];
+        while (estimate >= BASE || estimate * v[n - 2] > (rest << 32 | u[j + n - 2])) {
+            estimate--;
+            rest += v[n - 1];
+            if (rest >= BASE) {
+                break;
+            }
+        }
+
+        uint64_t carry = 0;
+        int64_t borrow = 0;
+        for (size_t i = 0; i < n; i++) {
+            uint64_t product = estimate * v[i] + carry;
+            carry = product >> 32;
+            int64_t digit = int64_t(u[i + j]) - borrow - int64_t(product & 0xFFFFFFFFu);
+            u[i + j] = static_cast<uint32_t>(digit);
+            borrow = digit < 0 ? 1 : 0;
+        }
+        int64_t top = int64_t(u[j + n]) - borrow - int64_t(carry);
+        u[j + n] = static_cast<uint32_t>(top);
+
+        // The estimate was one too large: add the divisor back.
+        if (top < 0) {
+            estimate--;
+            carry = 0;
+            for (size_t i = 0; i < n; i++) {
+                uint64_t digit = uint64_t(u[i + j]) + v[i] + carry;
+                u[i + j] = static_cast<uint32_t>(digit);
+                carry = digit >> 32;
+            }
+            u[j + n] += static_cast<uint32_t>(carry);
+        }
+        quotient[j] = static_cast<uint32_t>(estimate);
+    }
+    trim(quotient);
+    return quotient;
+}
+
+}
+
+BigInt::BigInt(bool negative, std::vector<uint32_t> magnitude) : limbs(std::move(magnitude)) {
+    trim(limbs);
+    this->negative = negative && !limbs.empty();
+}
+
+BigInt::BigInt(int64_t value) : negative(value < 0) {
+    uint64_t magnitude = negative ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+    while (magnitude) {
+        limbs.push_back(static_cast<uint32_t>(magnitude));
+        magnitude >>= 32;
+    }
+}
+
+bool BigInt::parse(std::string_view text, BigInt& result) {
+    bool negative = !text.empty() && text[0] == '-';
+    std::string_view digits = text.substr(negative ? 1 : 0);
+    if (digits.empty()) {
+        return false;
+    }
+    for (char c : digits) {
+        if (c < '0' || c > '9') {
+            return false;
+        }
+    }
+
+    // The first chunk takes the digits left over from whole chunks.
+    Limbs limbs;
+    size_t chunk = digits.size() % CHUNK_DIGITS;
+    if (chunk == 0) {
+        chunk = CHUNK_DIGITS;
+    }
+    for (size_t at = 0; at < digits.size(); at += chunk, chunk = CHUNK_DIGITS) {
+        uint32_t value = 0;
+        uint32_t scale = 1;
+        for (size_t i = at; i < at + chunk; i++) {
+            value = value * 10 + static_cast<uint32_t>(digits[i] - '0');
+            scale *= 10;
+        }
+        multiplySmallAdd(limbs, scale, value);
+    }
+
+    result = BigInt(negative, std::move(limbs));
+    return true;
+}
+
+std::string BigInt::toString() const {
+    if (limbs.empty()) {
+        return "0";
+    }
+
+    std::vector<uint32_t> chunks;
+    Limbs rest = limbs;
+    while (!rest.empty()) {
+        chunks.push_back(divideSmall(rest, CHUNK));
+    }
+
+    std::string text = negative ? "-" : "";
+    text += std::to_string(chunks.back());
+    for (size_t i = chunks.size() - 1; i-- > 0;) {
+        std::string chunk = std::to_string(chunks[i]);
+        text.append(CHUNK_DIGITS - chunk.size(), '0');
+        text += chunk;
+    }
+    return text;
+}
+
+bool BigInt::fitsInt64() const {
+    if (limbs.size() > 2) {
+        return false;
+    }
+    uint64_t magnitude = limbs.empty() ? 0 : limbs[0] | (limbs.size() > 1 ? uint64_t(limbs[1]) << 32 : 0);
+    return magnitude <= uint64_t(INT64_MAX) + (negative ? 1 : 0);
+}
+
+int64_t BigInt::toInt64() const {
+    uint64_t magnitude = limbs.empty() ? 0 : limbs[0] | (limbs.size() > 1 ? uint64_t(limbs[1]) << 32 : 0);
+    if (negative) {
+        return -static_cast<int64_t>(magnitude - 1) - 1;
+    }
+    return static_cast<int64_t>(magnitude);
+}
+
+size_t BigInt::hash() const {
+    size_t hash = negative ? 0x9e3779b97f4a7c15ULL : 0;
+    for (uint32_t limb : limbs) {
+        hash ^= limb + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+    }
+    return hash;
+}
+
+BigInt operator+(const BigInt& left, const BigInt& right) {
+    if (left.negative == right.negative) {
+        return BigInt(left.negative, addMagnitudes(left.limbs.data(), left.limbs.size(),
+                                                   right.limbs.data(), right.limbs.size()));
+    }
+    // The sign is that of the operand with the larger magnitude.
+    bool leftLarger = compareMagnitudes(left.limbs, right.limbs) >= 0;
+    const BigInt& larger = leftLarger ? left : right;
+    const BigInt& smaller = leftLarger ? right : left;
+    Limbs difference = larger.limbs;
+    subtractInPlace(difference, smaller.limbs.data(), smaller.limbs.size());
+    return BigInt(larger.negative, std::move(difference));
+}
+
+BigInt operator-(const BigInt& left, const BigInt& right) {
+    BigInt negated = right;
+    negated.negative = !right.negative && !right.limbs.empty();
+    return left + negated;
+}
+
+BigInt operator*(const BigInt& left, const BigInt& right) {
+    return BigInt(left.negative != right.negative, multiplyMagnitudes(left.limbs.data(), left.limbs.size(),
+                                                                     right.limbs.data(), right.limbs.size()));
+}
+
+BigInt operator/(const BigInt& left, const BigInt& right) {
+    return BigInt(left.negative != right.negative, divideMagnitudes(left.limbs, right.limbs));
+}
+
+bool operator<(const BigInt& left, const BigInt& right) {
+    if (left.negative != right.negative) {
+        return left.negative;
+    }
+    int order = compareMagnitudes(left.limbs, right.limbs);
+    return left.negative ? order > 0 : order < 0;
+}
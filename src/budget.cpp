@@ -0,0 +1,65 @@
+#include "budget.h"
+#include "bigint.h"
+#include "error.h"
+#include <algorithm>
+#include <string>
+
+void CallBudget::setLimits(const RunLimits& newLimits) {
+    limits = newLimits;
+    maxDepth = limits.maxDepth ? limits.maxDepth : SIZE_MAX;
+}
+
+void CallBudget::start() {
+    spent = 0;
+    depth = 0;
+    workLeft = WORK_INTERVAL;
+    if (limits.timeout.count()) {
+        deadline = std::chrono::steady_clock::now() + limits.timeout;
+    }
+    issue();
+}
+
+// The call that ran the countdown out has been made, so it is counted in
+// `spent`; the countdown is issued one past the calls left so that only a
+// call over the limit runs it out.
+void CallBudget::refill() {
+    spent += issued;
+    if (limits.maxCalls && spent > limits.maxCalls) {
+        throw LimitError("Call limit of " + std::to_string(limits.maxCalls) + " exceeded");
+    }
+    if (limits.timeout.count()) {
+        checkClock();
+    }
+    issue();
+}
+
+void CallBudget::operateBig(const Value& left, const Value& right) {
+    if (!limits.timeout.count()) {
+        return;
+    }
+    uint64_t limbs = (left.isBig() ? left.asBig().size() : 1) + (right.isBig() ? right.asBig().size() : 1);
+    if (workLeft > limbs) {
+        workLeft -= limbs;
+        return;
+    }
+    checkClock();
+}
+
+void CallBudget::checkClock() {
+    if (std::chrono::steady_clock::now() >= deadline) {
+        throw LimitError("Time limit of " + std::to_string(limits.timeout.count()) + " ms exceeded");
+    }
+    workLeft = WORK_INTERVAL;
+}
+
+void CallBudget::issue() {
+    issued = limits.timeout.count() ? CHECK_INTERVAL : UINT64_MAX;
+    if (limits.maxCalls) {
+        issued = std::min(issued, limits.maxCalls - spent + 1);
+    }
+    countdown = issued;
+}
+
+void CallBudget::tooDeep() const {
+    throw LimitError("Call depth limit of " + std::to_string(limits.maxDepth) + " exceeded");
+}
@@ -0,0 +1,158 @@
+#include "compiler.h"
+#include "error.h"
+
+Compiler::Compiler(CompiledFunction& target) : target(target) {}
+
+std::unique_ptr<CompiledFunction> Compiler::compile(FunctionDefAST& functionDef) {
+    auto function = std::make_unique<CompiledFunction>();
+    function->name = functionDef.getName();
+    function->params.assign(functionDef.getParams().begin(), functionDef.getParams().end());
+    function->frameSize = functionDef.getFrameSize();
+    function->pure = functionDef.isPure();
+
+    Compiler compiler(*function);
+
+    for (StatementAST* stmt : functionDef.getBody()) {
+        stmt->accept(compiler);
+    }
+
+    if (!functionDef.getReturnExpr()) {
+        throw SyntaxError("Function " + symbolName(function->name) + " has no return expression");
+    }
+    compiler.tailPosition = true;
+    functionDef.getReturnExpr()->accept(compiler);
+    compiler.emit(OpCode::RETURN);
+
+    return function;
+}
+
+void Compiler::visit(ExprAST& expr) {
+    (void)expr;
+    throw SyntaxError("Cannot compile untyped expression");
+}
+
+void Compiler::visit(NumberAST& number) {
+    emit(OpCode::PUSH_CONST, addConstant(number.getValue()));
+}
+
+void Compiler::visit(IdentifierAST& identifier) {
+    if (identifier.getDepth() == 0) {
+        emit(OpCode::LOAD_LOCAL, checked(identifier.getSlot()));
+        return;
+    }
+
+    OuterRef ref;
+    ref.depth = static_cast<uint32_t>(identifier.getDepth());
+    ref.slot = static_cast<uint32_t>(identifier.getSlot());
+    ref.name = identifier.getName();
+    target.outers.push_back(ref);
+    emit(OpCode::LOAD_OUTER, checked(target.outers.size() - 1));
+}
+
+void Compiler::visit(BinaryOpAST& binary) {
+    tailPosition = false;
+    binary.getLeft()->accept(*this);
+    binary.getRight()->accept(*this);
+
+    switch (binary.getOp()) {
+        case '+': emit(OpCode::ADD); break;
+        case '-': emit(OpCode::SUB); break;
+        case '*': emit(OpCode::MUL); break;
+        case '/': emit(OpCode::DIV); break;
+        case '=': emit(OpCode::EQ); break;
+        case '!': emit(OpCode::NOT_EQ); break;
+        case '<': emit(OpCode::LESS); break;
+        default:
+            throw SyntaxError("Unknown binary operator");
+    }
+}
+
+void Compiler::visit(TernaryExprAST& ternary) {
+    // Both arms inherit the tail position of the whole expression.
+    bool tail = tailPosition;
+
+    tailPosition = false;
+    ternary.getCondition()->accept(*this);
+    size_t jumpToElse = emit(OpCode::JUMP_IF_FALSE);
+
+    tailPosition = tail;
+    ternary.getThenExpr()->accept(*this);
+    size_t jumpToEnd = emit(OpCode::JUMP);
+
+    patch(jumpToElse, checked(target.code.size()));
+    tailPosition = tail;
+    ternary.getElseExpr()->accept(*this);
+
+    patch(jumpToEnd, checked(target.code.size()));
+}
+
+void Compiler::visit(FunctionCallAST& call) {
+    bool tail = tailPosition;
+    tailPosition = false;
+
+    CallSite site;
+    site.callee = call.getCallee();
+    site.argc = checked(call.getArgs().size());
+    target.calls.push_back(site);
+    uint32_t index = checked(target.calls.size() - 1);
+
+    // The callee is looked up before the arguments are evaluated, like the
+    // tree walker does, so error precedence is the same in both engines.
+    emit(OpCode::LOAD_FUNC, index);
+    for (ExprAST* arg : call.getArgs()) {
+        arg->accept(*this);
+    }
+    emit(tail ? OpCode::TAIL_CALL : OpCode::CALL, index);
+}
+
+void Compiler::visit(StatementAST& stmt) {
+    (void)stmt;
+    throw SyntaxError("Cannot compile untyped statement");
+}
+
+void Compiler::visit(AssignmentAST& assignment) {
+    assignment.getValue()->accept(*this);
+    emit(OpCode::STORE_LOCAL, checked(assignment.getSlot()));
+}
+
+void Compiler::visit(ReturnStmtAST& returnStmt) {
+    returnStmt.getReturnExpr()->accept(*this);
+    emit(OpCode::POP);
+}
+
+void Compiler::visit(FunctionDefAST& functionDef) {
+    target.nested.push_back(compile(functionDef));
+    emit(OpCode::DEFINE_FUNC, checked(target.nested.size() - 1));
+}
+
+size_t Compiler::emit(OpCode op, uint32_t operand) {
+    target.code.push_back(encode(op, operand));
+    return target.code.size() - 1;
+}
+
+void Compiler::patch(size_t at, uint32_t operand) {
+    target.code[at] = encode(opcodeOf(target.code[at]), operand);
+}
+
+uint32_t Compiler::checked(size_t index) {
+    if (index > MAX_OPERAND) {
+        throw SyntaxError("Function " + symbolName(target.name) + " is too large to compile");
+    }
+    return static_cast<uint32_t>(index);
+}
+
+// Big literals are rare enough that each gets a constant of its own.
+uint32_t Compiler::addConstant(const Value& value) {
+    if (!value.isBig()) {
+        auto it = constantIndex.find(value.asInt());
+        if (it != constantIndex.end()) {
+            return it->second;
+        }
+    }
+    target.constants.push_back(value);
+    uint32_t index = checked(target.constants.size() - 1);
+    if (!value.isBig()) {
+        constantIndex[value.asInt()] = index;
+    }
+    return index;
+}
@@ -0,0 +1,206 @@
+#include "flat_ast.h"
+#include "error.h"
+#include <map>
+#include <set>
+
+namespace {
+
+// Appends a node for each AST node it visits, the parent's index being
+// reserved before its children are added.
+class Flattener : public Visitor {
+    FlatFunction& target;
+    uint32_t& callSites;
+    uint32_t last = FlatFunction::NONE;
+
+public:
+    Flattener(FlatFunction& target, uint32_t& callSites) : target(target), callSites(callSites) {}
+
+    uint32_t add(NodeAST* node) {
+        node->accept(*this);
+        return last;
+    }
+
+    void visit(ExprAST& expr) override {
+        (void)expr;
+        throw SyntaxError("Cannot flatten untyped expression");
+    }
+
+    void visit(NumberAST& number) override {
+        uint32_t index = reserve(FlatNode::Kind::NUMBER);
+        FlatNode& node = target.nodes[index];
+        Value value = number.getValue();
+        if (value.isBig()) {
+            node.count = 1;
+            node.a = checked(target.constants.size());
+            target.constants.push_back(value);
+        } else {
+            uint64_t bits = static_cast<uint64_t>(value.asInt());
+            node.a = static_cast<uint32_t>(bits);
+            node.b = static_cast<uint32_t>(bits >> 32);
+        }
+        last = index;
+    }
+
+    void visit(IdentifierAST& identifier) override {
+        uint32_t index = reserve(FlatNode::Kind::IDENTIFIER);
+        FlatNode& node = target.nodes[index];
+        node.a = static_cast<uint32_t>(identifier.getSlot());
+        node.b = static_cast<uint32_t>(identifier.getDepth());
+        node.c = identifier.getName();
+        last = index;
+    }
+
+    void visit(BinaryOpAST& binary) override {
+        uint32_t index = reserve(FlatNode::Kind::BINARY_OP);
+        uint32_t left = add(binary.getLeft());
+        uint32_t right = add(binary.getRight());
+        FlatNode& node = target.nodes[index];
+        node.op = binary.getOp();
+        node.a = left;
+        node.b = right;
+        last = index;
+    }
+
+    void visit(TernaryExprAST& ternary) override {
+        uint32_t index = reserve(FlatNode::Kind::TERNARY);
+        uint32_t condition = add(ternary.getCondition());
+        uint32_t thenExpr = add(ternary.getThenExpr());
+        uint32_t elseExpr = add(ternary.getElseExpr());
+        FlatNode& node = target.nodes[index];
+        node.a = condition;
+        node.b = thenExpr;
+        node.c = elseExpr;
+        last = index;
+    }
+
+    void visit(FunctionCallAST& call) override {
+        uint32_t index = reserve(FlatNode::Kind::CALL);
+        if (call.getArgs().size() > UINT16_MAX) {
+            throw SyntaxError("Function " + symbolName(target.name) + " makes a call with too many arguments");
+        }
+        std::vector<uint32_t> args;
+        args.reserve(call.getArgs().size());
+        for (ExprAST* arg : call.getArgs()) {
+            args.push_back(add(arg));
+        }
+
+        FlatNode& node = target.nodes[index];
+        node.count = static_cast<uint16_t>(args.size());
+        node.a = call.getCallee();
+        node.b = checked(target.arguments.size());
+        node.c = checked(callSites++);
+        target.arguments.insert(target.arguments.end(), args.begin(), args.end());
+        last = index;
+    }
+
+    void visit(StatementAST& stmt) override {
+        (void)stmt;
+        throw SyntaxError("Cannot flatten untyped statement");
+    }
+
+    void visit(AssignmentAST& assignment) override {
+        uint32_t index = reserve(FlatNode::Kind::ASSIGNMENT);
+        uint32_t value = add(assignment.getValue());
+        FlatNode& node = target.nodes[index];
+        node.a = static_cast<uint32_t>(assignment.getSlot());
+        node.b = value;
+        last = index;
+    }
+
+    void visit(ReturnStmtAST& returnStmt) override {
+        uint32_t index = reserve(FlatNode::Kind::RETURN);
+        uint32_t expr = add(returnStmt.getReturnExpr());
+        target.nodes[index].a = expr;
+        last = index;
+    }
+
+    void visit(FunctionDefAST& functionDef) override {
+        uint32_t index = reserve(FlatNode::Kind::FUNCTION_DEF);
+        target.nodes[index].a = checked(target.nested.size());
+        target.nested.push_back(FlatFunction::flatten(functionDef, callSites));
+        last = index;
+    }
+
+private:
+    uint32_t reserve(FlatNode::Kind kind) {
+        uint32_t index = checked(target.nodes.size());
+        FlatNode node;
+        node.kind = kind;
+        target.nodes.push_back(node);
+        return index;
+    }
+
+    uint32_t checked(size_t index) {
+        if (index >= FlatFunction::NONE) {
+            throw SyntaxError("Function " + symbolName(target.name) + " is too large to evaluate");
+        }
+        return static_cast<uint32_t>(index);
+    }
+};
+
+void collectNestedNames(const FlatFunction& func, std::set<Symbol>& names) {
+    for (const FlatFunction& nested : func.nested) {
+        names.insert(nested.name);
+        collectNestedNames(nested, names);
+    }
+}
+
+// Fills in the sites of `func` and its nested functions that always reach
+// the same top-level function.
+void resolveCalls(const FlatFunction& func, const std::map<Symbol, const FlatFunction*>& globals,
+                  const std::set<Symbol>& nestedNames, std::vector<const FlatFunction*>& targets) {
+    for (const FlatNode& node : func.nodes) {
+        if (node.kind != FlatNode::Kind::CALL || nestedNames.count(node.a)) {
+            continue;
+        }
+        auto it = globals.find(node.a);
+        if (it != globals.end() && it->second->paramCount == node.count) {
+            targets[node.c] = it->second;
+        }
+    }
+    for (const FlatFunction& nested : func.nested) {
+        resolveCalls(nested, globals, nestedNames, targets);
+    }
+}
+
+}
+
+FlatFunction FlatFunction::flatten(const FunctionDefAST& func, uint32_t& callSites) {
+    FlatFunction flat;
+    flat.name = func.getName();
+    flat.paramCount = func.getParams().size();
+    flat.frameSize = func.getFrameSize();
+    flat.pure = func.isPure();
+
+    Flattener flattener(flat, callSites);
+    for (StatementAST* stmt : func.getBody()) {
+        flat.body.push_back(flattener.add(stmt));
+    }
+    if (func.getReturnExpr()) {
+        flat.returnExpr = flattener.add(func.getReturnExpr());
+    }
+    return flat;
+}
+
+FlatProgram::FlatProgram(const std::vector<FunctionDefAST*>& ast) {
+    uint32_t callSites = 0;
+    functions.reserve(ast.size());
+    for (FunctionDefAST* func : ast) {
+        functions.push_back(FlatFunction::flatten(*func, callSites));
+    }
+
+    // Lookups go through the callers' frames, so a name is only certain to
+    // reach its top-level definition when no function defines it as
+    // nested. A later top-level def replaces an earlier one.
+    std::map<Symbol, const FlatFunction*> globals;
+    std::set<Symbol> nestedNames;
+    for (const FlatFunction& func : functions) {
+        globals[func.name] = &func;
+        collectNestedNames(func, nestedNames);
+    }
+
+    targets.assign(callSites, nullptr);
+    for (const FlatFunction& func : functions) {
+        resolveCalls(func, globals, nestedNames, targets);
+    }
+}
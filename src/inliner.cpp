@@ -0,0 +1,361 @@
+#include "inliner.h"
+#include <algorithm>
+
+namespace {
+
+// Raised while expanding a call whose body cannot stand in for it.
+struct NotInlinable {};
+
+size_t countNodes(const ExprAST* expr) {
+    if (auto binary = dynamic_cast<const BinaryOpAST*>(expr)) {
+        return 1 + countNodes(binary->getLeft()) + countNodes(binary->getRight());
+    }
+    if (auto ternary = dynamic_cast<const TernaryExprAST*>(expr)) {
+        return 1 + countNodes(ternary->getCondition()) + countNodes(ternary->getThenExpr()) +
+               countNodes(ternary->getElseExpr());
+    }
+    if (auto call = dynamic_cast<const FunctionCallAST*>(expr)) {
+        size_t count = 1;
+        for (const ExprAST* arg : call->getArgs()) {
+            count += countNodes(arg);
+        }
+        return count;
+    }
+    return 1;
+}
+
+bool isNonZeroLiteral(const ExprAST* expr) {
+    auto number = dynamic_cast<const NumberAST*>(expr);
+    return number && !number->getValue().isZero();
+}
+
+void collectNestedNames(const FunctionDefAST& function, std::set<Symbol>& names) {
+    for (StatementAST* stmt : function.getBody()) {
+        if (auto nested = dynamic_cast<FunctionDefAST*>(stmt)) {
+            names.insert(nested->getName());
+            collectNestedNames(*nested, names);
+        }
+    }
+}
+
+}
+
+Inliner::Inliner(Arena& arena, size_t limit) : arena(arena), limit(limit) {}
+
+std::vector<InlinedCall> Inliner::inlineCalls(ProgramAST& program, size_t limit) {
+    if (limit == 0) {
+        return {};
+    }
+
+    Inliner inliner(program.getArena(), limit);
+    // A later top-level def replaces an earlier one of the same name, as it
+    // does when the program is loaded.
+    for (FunctionDefAST* func : program.getFunctions()) {
+        inliner.globals[func->getName()] = func;
+        collectNestedNames(*func, inliner.nestedNames);
+    }
+
+    // Callees are rewritten before their callers, so what a caller takes in
+    // has already taken in its own callees.
+    for (FunctionDefAST* func : program.getFunctions()) {
+        if (inliner.states[func] == State::Unvisited) {
+            inliner.process(*func);
+        }
+    }
+    return std::move(inliner.report);
+}
+
+void Inliner::process(FunctionDefAST& function) {
+    states[&function] = State::Open;
+    open.push_back(&function);
+    function.accept(*this);
+    open.pop_back();
+    states[&function] = State::Done;
+}
+
+ExprAST* Inliner::rewrite(ExprAST* expr) {
+    replacement = expr;
+    expr->accept(*this);
+    return replacement;
+}
+
+void Inliner::visit(ExprAST& expr) {
+    (void)expr;
+}
+
+void Inliner::visit(NumberAST& number) {
+    (void)number;
+}
+
+void Inliner::visit(IdentifierAST& identifier) {
+    (void)identifier;
+}
+
+void Inliner::visit(BinaryOpAST& binary) {
+    ExprAST* left = rewrite(binary.getLeft());
+    ExprAST* right = rewrite(binary.getRight());
+    binary.setOperands(left, right);
+    replacement = &binary;
+}
+
+void Inliner::visit(TernaryExprAST& ternary) {
+    ExprAST* condition = rewrite(ternary.getCondition());
+    ExprAST* then_expr = rewrite(ternary.getThenExpr());
+    ExprAST* else_expr = rewrite(ternary.getElseExpr());
+    ternary.setArms(condition, then_expr, else_expr);
+    replacement = &ternary;
+}
+
+void Inliner::visit(FunctionCallAST& call) {
+    for (ExprAST*& arg : call.getArgs()) {
+        arg = rewrite(arg);
+    }
+
+    ExprAST* body = nullptr;
+    FunctionDefAST* callee = target(call);
+    if (callee) {
+        if (states[callee] == State::Unvisited) {
+            process(*callee);
+        } else if (states[callee] == State::Open) {
+            // Every function from the callee to the one being rewritten is
+            // on a cycle of calls.
+            recursive.insert(std::find(open.begin(), open.end(), callee), open.end());
+        }
+        if (canInline(*callee)) {
+            body = inlineCall(call, *callee);
+        }
+    }
+
+    if (!body) {
+        replacement = &call;
+        return;
+    }
+
+    Symbol caller = callers.back()->getName();
+    auto entry = std::find_if(report.begin(), report.end(), [&](const InlinedCall& inlined) {
+        return inlined.caller == caller && inlined.callee == callee->getName();
+    });
+    if (entry == report.end()) {
+        report.push_back(InlinedCall{caller, callee->getName(), 1});
+    } else {
+        entry->sites++;
+    }
+    replacement = body;
+}
+
+void Inliner::visit(StatementAST& stmt) {
+    (void)stmt;
+}
+
+void Inliner::visit(AssignmentAST& assignment) {
+    assignment.setValue(rewrite(assignment.getValue()));
+}
+
+void Inliner::visit(ReturnStmtAST& returnStmt) {
+    returnStmt.setReturnExpr(rewrite(returnStmt.getReturnExpr()));
+}
+
+void Inliner::visit(FunctionDefAST& functionDef) {
+    callers.push_back(&functionDef);
+    for (StatementAST* stmt : functionDef.getBody()) {
+        stmt->accept(*this);
+    }
+    if (functionDef.getReturnExpr()) {
+        functionDef.setReturnExpr(rewrite(functionDef.getReturnExpr()));
+    }
+    callers.pop_back();
+}
+
+// The top-level function a call is sure to reach, with the right number of
+// arguments, or nullptr.
+FunctionDefAST* Inliner::target(const FunctionCallAST& call) const {
+    if (nestedNames.count(call.getCallee())) {
+        return nullptr;
+    }
+    auto it = globals.find(call.getCallee());
+    if (it == globals.end() || it->second->getParams().size() != call.getArgs().size()) {
+        return nullptr;
+    }
+    return it->second;
+}
+
+bool Inliner::canInline(const FunctionDefAST& callee) const {
+    if (recursive.count(&callee) || !callee.getReturnExpr()) {
+        return false;
+    }
+    size_t size = countNodes(callee.getReturnExpr());
+    for (StatementAST* stmt : callee.getBody()) {
+        auto assignment = dynamic_cast<AssignmentAST*>(stmt);
+        if (!assignment) {
+            return false;
+        }
+        size += countNodes(assignment->getValue());
+    }
+    return size <= limit;
+}
+
+// Binds the arguments and then each assignment in order, and expands the
+// return expression over them. Returns nullptr if the result would not
+// behave exactly like the call.
+ExprAST* Inliner::inlineCall(const FunctionCallAST& call, const FunctionDefAST& callee) {
+    bindings.clear();
+    seen = -1;
+
+    std::vector<int> scope(callee.getFrameSize(), -1);
+    for (ExprAST* arg : call.getArgs()) {
+        Binding binding;
+        binding.value = arg;
+        binding.inCaller = true;
+        binding.mayFail = mayFail(arg, nullptr);
+        auto identifier = dynamic_cast<IdentifierAST*>(arg);
+        if (dynamic_cast<NumberAST*>(arg) || (identifier && identifier->getDepth() == 0)) {
+            binding.leaf = arg;
+        }
+        scope[bindings.size()] = static_cast<int>(bindings.size());
+        bindings.push_back(std::move(binding));
+    }
+
+    for (StatementAST* stmt : callee.getBody()) {
+        auto assignment = static_cast<AssignmentAST*>(stmt);
+        Binding binding;
+        binding.value = assignment->getValue();
+        binding.inCaller = false;
+        binding.scope = scope;
+        binding.mayFail = mayFail(binding.value, &scope);
+        if (dynamic_cast<NumberAST*>(binding.value)) {
+            binding.leaf = binding.value;
+        } else if (auto identifier = dynamic_cast<IdentifierAST*>(binding.value)) {
+            binding.leaf = bindings[scope[identifier->getSlot()]].leaf;
+        }
+        scope[assignment->getSlot()] = static_cast<int>(bindings.size());
+        bindings.push_back(std::move(binding));
+    }
+
+    try {
+        ExprAST* body = expand(callee.getReturnExpr(), &scope, static_cast<int>(bindings.size()), false);
+        for (const Binding& binding : bindings) {
+            if (binding.mayFail && binding.uses == 0) {
+                return nullptr;
+            }
+        }
+        return body;
+    } catch (const NotInlinable&) {
+        return nullptr;
+    }
+}
+
+// Copies `expr` with every identifier of the callee replaced by what its
+// binding holds; an expression of the caller, with no scope, is returned
+// as it is. Along the way every point where evaluation could fail or make
+// a call is checked against the order the call would have run them in:
+// `origin` is the binding being expanded, or one past the last for the
+// return expression.
+ExprAST* Inliner::expand(ExprAST* expr, const std::vector<int>* scope, int origin, bool inArm) {
+    if (auto identifier = dynamic_cast<IdentifierAST*>(expr)) {
+        if (scope) {
+            return reference((*scope)[identifier->getSlot()], inArm);
+        }
+        // An outer variable may not be assigned yet.
+        if (identifier->getDepth() != 0) {
+            effect(origin);
+        }
+        return expr;
+    }
+
+    if (auto binary = dynamic_cast<BinaryOpAST*>(expr)) {
+        ExprAST* left = expand(binary->getLeft(), scope, origin, inArm);
+        ExprAST* right = expand(binary->getRight(), scope, origin, inArm);
+        if (binary->getOp() == '/' && !isNonZeroLiteral(right)) {
+            effect(origin);
+        }
+        return scope ? arena.make<BinaryOpAST>(binary->getOp(), left, right) : expr;
+    }
+
+    if (auto ternary = dynamic_cast<TernaryExprAST*>(expr)) {
+        ExprAST* condition = expand(ternary->getCondition(), scope, origin, inArm);
+        int before = seen;
+        ExprAST* then_expr = expand(ternary->getThenExpr(), scope, origin, true);
+        int afterThen = seen;
+        seen = before;
+        ExprAST* else_expr = expand(ternary->getElseExpr(), scope, origin, true);
+        seen = std::max(seen, afterThen);
+        return scope ? arena.make<TernaryExprAST>(condition, then_expr, else_expr) : expr;
+    }
+
+    if (auto call = dynamic_cast<FunctionCallAST*>(expr)) {
+        // The bytecode engine looks the callee up before evaluating the
+        // arguments, and that can fail too.
+        if (!target(*call)) {
+            effect(origin);
+        }
+        std::vector<ExprAST*> args;
+        for (ExprAST* arg : call->getArgs()) {
+            args.push_back(expand(arg, scope, origin, inArm));
+        }
+        effect(origin);
+        if (!scope) {
+            return expr;
+        }
+        return arena.make<FunctionCallAST>(call->getCallee(), copyToArena<ExprAST*>(arena, args.begin(), args.end()));
+    }
+
+    return scope ? copyLeaf(expr) : expr;
+}
+
+ExprAST* Inliner::reference(int index, bool inArm) {
+    Binding& binding = bindings[index];
+    if (binding.leaf) {
+        return copyLeaf(binding.leaf);
+    }
+    // Anything else is evaluated where it is used, so it must be used once,
+    // and only where the call would have evaluated it for sure if it can
+    // fail.
+    if (binding.uses++ > 0 || (binding.mayFail && inArm)) {
+        throw NotInlinable();
+    }
+    return expand(binding.value, binding.inCaller ? nullptr : &binding.scope, index, inArm);
+}
+
+void Inliner::effect(int origin) {
+    if (origin < seen) {
+        throw NotInlinable();
+    }
+    seen = origin;
+}
+
+bool Inliner::mayFail(ExprAST* expr, const std::vector<int>* scope) const {
+    if (auto identifier = dynamic_cast<IdentifierAST*>(expr)) {
+        return scope ? bindings[(*scope)[identifier->getSlot()]].mayFail : identifier->getDepth() != 0;
+    }
+    if (auto binary = dynamic_cast<BinaryOpAST*>(expr)) {
+        if (binary->getOp() == '/') {
+            ExprAST* divisor = binary->getRight();
+            auto identifier = dynamic_cast<IdentifierAST*>(divisor);
+            if (scope && identifier) {
+                divisor = bindings[(*scope)[identifier->getSlot()]].leaf;
+            }
+            if (!isNonZeroLiteral(divisor)) {
+                return true;
+            }
+        }
+        return mayFail(binary->getLeft(), scope) || mayFail(binary->getRight(), scope);
+    }
+    if (auto ternary = dynamic_cast<TernaryExprAST*>(expr)) {
+        return mayFail(ternary->getCondition(), scope) || mayFail(ternary->getThenExpr(), scope) ||
+               mayFail(ternary->getElseExpr(), scope);
+    }
+    return dynamic_cast<FunctionCallAST*>(expr) != nullptr;
+}
+
+ExprAST* Inliner::copyLeaf(ExprAST* leaf) {
+    if (auto identifier = dynamic_cast<IdentifierAST*>(leaf)) {
+        auto copy = arena.make<IdentifierAST>(identifier->getName());
+        copy->setResolved(identifier->getDepth(), identifier->getSlot());
+        return copy;
+    }
+    auto number = static_cast<NumberAST*>(leaf);
+    if (number->isBig()) {
+        return arena.make<NumberAST>(number->getDigits());
+    }
+    return arena.make<NumberAST>(number->getValue().asInt());
+}
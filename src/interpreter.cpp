@@ -1,239 +1,651 @@
 #include "interpreter.h"
 #include "error.h"
-#include <sstream>
+#include "lanes.h"
+#include "native_stack.h"
+#include "stats.h"
+#include <algorithm>
+#include <utility>
 
-Evaluator::Evaluator(Environment& env) : env(env), result(nullptr) {}
+Evaluator::Evaluator(const FlatFunction& function, Environment& env, EvaluatorState& state)
+    : function(function), env(env), state(state) {
+    TOY_STAT(evaluators++);
+}
 
-std::unique_ptr<Value> Evaluator::evaluate(NodeAST* node) {
-    if (!node) {
-        return nullptr;
+Value Evaluator::evaluate(uint32_t index) {
+    if (index == FlatFunction::NONE) {
+        return Value();
     }
     
-    result = nullptr;
-    
-    node->accept(*this);
+    const FlatNode& node = function.nodes[index];
+    TOY_STAT(nodes[static_cast<size_t>(node.kind)]++);
     
-    return std::move(result);
-}
-
-void Evaluator::visit(ExprAST& expr) {
-    (void)expr;
+    switch (node.kind) {
+        case FlatNode::Kind::NUMBER:
+            if (node.count) {
+                return function.constants[node.a];
+            }
+            return Value(static_cast<int64_t>(uint64_t(node.b) << 32 | node.a));
+            
+        case FlatNode::Kind::IDENTIFIER:
+            return variable(node);
+            
+        case FlatNode::Kind::BINARY_OP: {
+            Value leftScratch, rightScratch;
+            const Value& leftEval = operand(node.a, leftScratch);
+            const Value& rightEval = operand(node.b, rightScratch);
+            if (leftEval.isNil() || rightEval.isNil()) {
+                throw RuntimeError("Invalid operands in binary operation");
+            }
+            state.budget.operate(leftEval, rightEval);
+            switch (node.op) {
+                case '+': return Value::add(leftEval, rightEval);
+                case '-': return Value::subtract(leftEval, rightEval);
+                case '*': return Value::multiply(leftEval, rightEval);
+                case '/':
+                    if (rightEval.isZero()) {
+                        throw RuntimeError("Division by zero");
+                    }
+                    return Value::divide(leftEval, rightEval);
+                case '=': return Value(Value::equal(leftEval, rightEval) ? 1 : 0);
+                case '!': return Value(Value::equal(leftEval, rightEval) ? 0 : 1);
+                case '<': return Value(Value::less(leftEval, rightEval) ? 1 : 0);
+                default:
+                    throw RuntimeError("Unknown binary operator");
+            }
+        }
+            
+        case FlatNode::Kind::TERNARY:
+            return evaluate(evaluateCondition(node) ? node.b : node.c);
+            
+        case FlatNode::Kind::CALL: {
+            const FlatFunction* func = nullptr;
+            auto funcEnv = prepareCall(node, env, func);
+            // A plain call goes straight to the function, so that each call
+            // in the script costs as little C++ stack as it can.
+            if (state.profiler || state.memo) {
+                return callFunction(func, std::move(funcEnv), state);
+            }
+            return runFunction(func, std::move(funcEnv), state);
+        }
+            
+        case FlatNode::Kind::ASSIGNMENT: {
+            Value value = evaluate(node.b);
+            if (value.isNil()) {
+                throw RuntimeError("Invalid expression in assignment");
+            }
+            env.defineVariable(static_cast<int>(node.a), std::move(value));
+            return Value();
+        }
+            
+        case FlatNode::Kind::RETURN:
+            return evaluate(node.a);
+            
+        case FlatNode::Kind::FUNCTION_DEF:
+            env.defineFunction(function.nested[node.a]);
+            state.epoch++;
+            return Value();
+    }
+    return Value();
 }
 
-void Evaluator::visit(NumberAST& number) {
-    result = std::make_unique<IntValue>(number.getValue());
+const Value& Evaluator::variable(const FlatNode& identifier) {
+    TOY_STAT(variableLookups++);
+    TOY_STAT(variableHops += identifier.b);
+    Value* val = env.getVariable(static_cast<int>(identifier.b), static_cast<int>(identifier.a));
+    if (val->isNil()) {
+        throw NameError("Undefined variable: " + symbolName(identifier.c));
+    }
+    return *val;
 }
 
-void Evaluator::visit(IdentifierAST& identifier) {
-    Value* val = env.getVariable(identifier.getName());
-    if (!val) {
-        throw NameError("Undefined variable: " + identifier.getName());
+// Variables are read in place rather than copied, which for a big value
+// would touch its reference count twice for nothing.
+const Value& Evaluator::operand(uint32_t index, Value& scratch) {
+    const FlatNode& node = function.nodes[index];
+    if (node.kind == FlatNode::Kind::IDENTIFIER) {
+        TOY_STAT(nodes[static_cast<size_t>(node.kind)]++);
+        return variable(node);
     }
-    result = std::make_unique<IntValue>(val->asInt());
+    scratch = evaluate(index);
+    return scratch;
 }
 
-void Evaluator::visit(BinaryOpAST& binary) {
-    auto leftEval = evaluate(binary.getLeft());
-    auto rightEval = evaluate(binary.getRight());
+// Finds the callee of `call` from this frame and returns the frame that
+// defines it. Only a call site whose callee may differ between callers
+// looks the name up, and then only when its cached callee is stale.
+Environment* Evaluator::resolve(const FlatNode& call, const FlatFunction*& func) {
+    if (const FlatFunction* target = state.program.getTarget(call.c)) {
+        func = target;
+        return &state.globals;
+    }
     
-    if (!leftEval || !rightEval) {
-        throw RuntimeError("Invalid operands in binary operation");
+    EvaluatorState::CachedCall& cached = state.calls[call.c];
+    if (cached.epoch == state.epoch) {
+        func = cached.function;
+        return cached.scope;
     }
     
-    int left = leftEval->asInt();
-    int right = rightEval->asInt();
-    int value = 0;
+    Symbol callee = call.a;
+    Environment* scope = nullptr;
+    func = env.getFunction(callee, &scope);
     
-
-    switch (binary.getOp()) {
-        case '+': value = left + right; break;
-        case '-': value = left - right; break;
-        case '*': value = left * right; break;
-        case '/': 
-            if (right == 0) {
-                throw RuntimeError("Division by zero");
-            }
-            value = left / right; 
-            break;
-        case '=': value = (left == right) ? 1 : 0; break; 
-        case '!': value = (left != right) ? 1 : 0; break; 
-        case '<': value = (left < right) ? 1 : 0; break;
-        default:
-            throw RuntimeError("Unknown binary operator");
+    if (!func) {
+        throw NameError("Undefined function: " + symbolName(callee));
+    }
+    
+    if (func->paramCount != call.count) {
+        throw RuntimeError("Function " + symbolName(callee) + " called with incorrect number of arguments");
     }
     
-    result = std::make_unique<IntValue>(value);
+    cached = EvaluatorState::CachedCall{state.epoch, func, scope};
+    return scope;
 }
 
-void Evaluator::visit(FunctionCallAST& call) {
-    const std::string& callee = call.getCallee();
-    auto func = env.getFunction(callee);
+std::unique_ptr<Environment> Evaluator::prepareCall(const FlatNode& call, Environment& parent, const FlatFunction*& func) {
+    Environment* scope = resolve(call, func);
+    auto funcEnv = state.newFrame(parent, scope, func->frameSize);
     
-    if (!func) {
-        throw NameError("Undefined function: " + callee);
+    const uint32_t* args = function.arguments.data() + call.b;
+    for (uint32_t i = 0; i < call.count; i++) {
+        funcEnv->defineVariable(static_cast<int>(i), evaluate(args[i]));
     }
     
-    const auto& params = func->getParams();
-    const auto& args = call.getArgs();
-    
+    return funcEnv;
+}
 
-    if (params.size() != args.size()) {
-        throw RuntimeError("Function " + callee + " called with incorrect number of arguments");
+Value Evaluator::callFunction(const FlatFunction* func, std::unique_ptr<Environment> funcEnv, EvaluatorState& state) {
+    if (state.profiler) {
+        return callProfiled(func, std::move(funcEnv), state);
+    }
+    return callMemoized(func, std::move(funcEnv), state);
+}
+
+// Kept apart from callFunction so that the unprofiled path carries no
+// cleanup for the timer.
+Value Evaluator::callProfiled(const FlatFunction* func, std::unique_ptr<Environment> funcEnv, EvaluatorState& state) {
+    Profiler::Call call(*state.profiler, func);
+    return callMemoized(func, std::move(funcEnv), state);
+}
+
+Value Evaluator::callMemoized(const FlatFunction* func, std::unique_ptr<Environment> funcEnv, EvaluatorState& state) {
+    MemoCache* memo = state.memo;
+    if (!memo || !func->pure) {
+        return runFunction(func, std::move(funcEnv), state);
     }
     
-    auto funcEnv = env.createChildEnv();
-    
- 
-    for (size_t i = 0; i < params.size(); i++) {
-        auto argValue = evaluate(args[i].get());
-        funcEnv->defineVariable(params[i], std::move(argValue));
+    size_t argc = func->paramCount;
+    Value result;
+    if (memo->lookup(func, funcEnv->getSlots(), argc, result)) {
+        return result;
     }
     
+    // Parameters may be reassigned by the body, so keep the key aside.
+    std::vector<Value> args(funcEnv->getSlots(), funcEnv->getSlots() + argc);
+    result = runFunction(func, std::move(funcEnv), state);
+    memo->store(func, args.data(), argc, result);
+    return result;
+}
 
-    Evaluator funcEvaluator(*funcEnv);
+Value Evaluator::runFunction(const FlatFunction* func, std::unique_ptr<Environment> funcEnv, EvaluatorState& state) {
+    char marker;
+    if (reinterpret_cast<uintptr_t>(&marker) < state.stackFloor) {
+        return runOnNewStack(func, std::move(funcEnv), state, reinterpret_cast<uintptr_t>(&marker));
+    }
+    TOY_STAT_NESTING();
+    state.budget.enter();
+    
+    // However the function is left, calls may have been resolved to
+    // functions this frame defined, and those go with it.
+    struct FrameExit {
+        std::unique_ptr<Environment>& env;
+        EvaluatorState& state;
+        ~FrameExit() {
+            if (env->definesFunctions()) {
+                state.epoch++;
+            }
+            state.recycle(std::move(env));
+            state.budget.leave();
+        }
+    } frameExit{funcEnv, state};
     
+    for (;;) {
+        Evaluator funcEvaluator(*func, *funcEnv, state);
+        
+        for (uint32_t stmt : func->body) {
+            funcEvaluator.evaluate(stmt);
+        }
+        
+        Value result;
+        uint32_t tailCall = funcEvaluator.evaluateTail(func->returnExpr, result);
+        if (tailCall == FlatFunction::NONE) {
+            return result;
+        }
+        
+        // Functions defined in this frame may still be looked up or refer
+        // to its slots, so it has to stay alive for an ordinary call.
+        if (funcEnv->definesFunctions()) {
+            return funcEvaluator.evaluate(tailCall);
+        }
+        
+        auto calleeEnv = funcEvaluator.prepareCall(func->nodes[tailCall], *funcEnv->getParent(), func);
+        state.recycle(std::move(funcEnv));
+        funcEnv = std::move(calleeEnv);
+        if (state.profiler) {
+            state.profiler->replace(func);
+        }
+        TOY_STAT(tailCalls++);
+        state.budget.replace();
+        
+        // The tail callee's result is this call's result.
+        Value cached;
+        MemoCache* memo = state.memo;
+        if (memo && func->pure &&
+            memo->lookup(func, funcEnv->getSlots(), func->paramCount, cached)) {
+            return cached;
+        }
+    }
+}
 
-    for (const auto& stmt : func->getBody()) {
-        funcEvaluator.evaluate(stmt.get());
+// The thread's stack has run out at `here`. Unless the stack limit has too,
+// the call is run on a new thread with a stack of what is left of it,
+// while this one waits.
+Value Evaluator::runOnNewStack(const FlatFunction* func, std::unique_ptr<Environment> funcEnv, EvaluatorState& state,
+                               uintptr_t here) {
+    size_t used = state.stackUsed + (state.stackTop - here);
+    if (used + NATIVE_STACK_RESERVE >= state.stackLimit) {
+        state.stackOverflow();
     }
     
-
-    result = funcEvaluator.evaluate(func->getReturnExpr());
+    size_t stackUsed = state.stackUsed;
+    uintptr_t stackTop = state.stackTop;
+    uintptr_t stackFloor = state.stackFloor;
+    RuntimeStats* stats = &RuntimeStats::current();
+    Value result;
+    std::exception_ptr error;
+    
+    bool ran = ::runOnNewStack(state.stackLimit - used + NATIVE_STACK_RESERVE, [&] {
+        RuntimeStats::Scope scope(*stats);
+        char marker;
+        state.stackUsed = used;
+        state.useStack(reinterpret_cast<uintptr_t>(&marker));
+        try {
+            result = runFunction(func, std::move(funcEnv), state);
+        } catch (...) {
+            error = std::current_exception();
+        }
+    });
+    
+    state.stackUsed = stackUsed;
+    state.stackTop = stackTop;
+    state.stackFloor = stackFloor;
+    if (!ran) {
+        state.stackOverflow();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    return result;
 }
 
-void Evaluator::visit(StatementAST& stmt) {
-    (void)stmt;
+// Returns the call the expression ends in, or NONE with its value in
+// `result`.
+uint32_t Evaluator::evaluateTail(uint32_t index, Value& result) {
+    while (index != FlatFunction::NONE) {
+        const FlatNode& node = function.nodes[index];
+        if (node.kind == FlatNode::Kind::CALL) {
+            TOY_STAT(nodes[RuntimeStats::CALL]++);
+            return index;
+        }
+        if (node.kind != FlatNode::Kind::TERNARY) {
+            break;
+        }
+        TOY_STAT(nodes[RuntimeStats::TERNARY]++);
+        index = evaluateCondition(node) ? node.b : node.c;
+    }
+    
+    result = evaluate(index);
+    return FlatFunction::NONE;
 }
 
-void Evaluator::visit(AssignmentAST& assignment) {
-    auto value = evaluate(assignment.getValue());
-    if (!value) {
-        throw RuntimeError("Invalid expression in assignment");
+bool Evaluator::evaluateCondition(const FlatNode& ternary) {
+    Value scratch;
+    const Value& conditionValue = operand(ternary.a, scratch);
+    if (conditionValue.isNil()) {
+        throw RuntimeError("Invalid condition in ternary expression");
     }
     
-    env.defineVariable(assignment.getVariable(), std::move(value));
-    result = nullptr; 
+    return !conditionValue.isZero();
+}
+
+
+Environment::Environment(Environment* parent, Environment* enclosing, size_t frameSize)
+    : slots(frameSize), parent(parent), enclosing(enclosing) {
+    TOY_STAT(environments++);
+    TOY_STAT(slotsAllocated += frameSize);
 }
 
-void Evaluator::visit(ReturnStmtAST& returnStmt) {
-    result = evaluate(returnStmt.getReturnExpr());
+void Environment::reset(Environment* parent, Environment* enclosing, size_t frameSize) {
+    TOY_STAT(environments++);
+    TOY_STAT(slotsAllocated += frameSize);
+    slots.resize(frameSize);
+    this->parent = parent;
+    this->enclosing = enclosing;
 }
 
-void Evaluator::visit(FunctionDefAST& functionDef) {
-    env.defineFunction(functionDef.getName(), functionDef.clone());
-    result = nullptr; 
+void Environment::clear() noexcept {
+    slots.clear();
+    functions.clear();
 }
 
+void Environment::defineVariable(int slot, Value value) {
+    slots[slot] = std::move(value);
+}
 
-Environment::Environment(Environment* parent) : parent(parent) {}
+Value* Environment::getVariable(int depth, int slot) {
+    Environment* frame = this;
+    for (int i = 0; i < depth; i++) {
+        frame = frame->enclosing;
+    }
+    return &frame->slots[slot];
+}
 
-void Environment::defineVariable(const std::string& name, std::unique_ptr<Value> value) {
-    variables[name] = std::move(value);
+void Environment::defineFunction(const FlatFunction& func) {
+    functions[func.name] = &func;
 }
-void Evaluator::visit(TernaryExprAST& ternary) {
-    auto conditionValue = evaluate(ternary.getCondition());
-    if (!conditionValue) {
-        throw RuntimeError("Invalid condition in ternary expression");
+
+const FlatFunction* Environment::getFunction(Symbol name, Environment** scope) {
+    TOY_STAT(functionLookups++);
+    for (Environment* frame = this; frame; frame = frame->parent) {
+        auto it = frame->functions.find(name);
+        if (it != frame->functions.end()) {
+            if (scope) {
+                *scope = frame;
+            }
+            return it->second;
+        }
+        TOY_STAT(functionHops++);
     }
     
-    bool condition = conditionValue->asInt() != 0;
-    
-    if (condition) {
-        result = evaluate(ternary.getThenExpr());
-    } else {
-        result = evaluate(ternary.getElseExpr());
+    return nullptr;
+}
+
+std::unique_ptr<Environment> Environment::createChildEnv(Environment* enclosing, size_t frameSize) {
+    return std::make_unique<Environment>(this, enclosing, frameSize);
+}
+
+
+std::unique_ptr<Environment> EvaluatorState::newFrame(Environment& parent, Environment* enclosing, size_t frameSize) {
+    if (spareFrames.empty()) {
+        return parent.createChildEnv(enclosing, frameSize);
     }
+    std::unique_ptr<Environment> frame = std::move(spareFrames.back());
+    spareFrames.pop_back();
+    frame->reset(&parent, enclosing, frameSize);
+    return frame;
+}
+
+void EvaluatorState::useStack(uintptr_t top) {
+    stackTop = top;
+    uintptr_t low = nativeStackLow() ? nativeStackLow() + NATIVE_STACK_RESERVE : 0;
+    uintptr_t left = stackLimit > stackUsed ? stackLimit - stackUsed : 0;
+    stackFloor = std::max(top > left ? top - left : 0, low);
 }
-Value* Environment::getVariable(const std::string& name) {
-    auto it = variables.find(name);
-    if (it != variables.end()) {
-        return it->second.get();
+
+void EvaluatorState::stackOverflow() const {
+    throw LimitError("Call stack limit of " + std::to_string(stackLimit) + " bytes exceeded");
+}
+
+// The spare frames are reserved up front, so keeping one never allocates.
+void EvaluatorState::recycle(std::unique_ptr<Environment> frame) noexcept {
+    if (frame && spareFrames.size() < MAX_SPARE_FRAMES) {
+        frame->clear();
+        spareFrames.push_back(std::move(frame));
     }
-    
-    if (parent) {
-        return parent->getVariable(name);
+}
+
+
+ExecutionContext::ExecutionContext(std::shared_ptr<const Program> program, Engine engine)
+    : program(std::move(program)), engine(engine), vm(this->program->getGlobalFrame(), budget) {
+    if (engine == Engine::Jit) {
+        vm.setJit(&this->program->getJit());
     }
-    
-    return nullptr;
 }
 
-void Environment::defineFunction(const std::string& name, std::unique_ptr<FunctionDefAST> func) {
-    functions[name] = std::move(func); 
+Value ExecutionContext::run(const std::string& function_name, const std::vector<Value>& args) {
+    Symbol name;
+    if (!program->lookup(function_name, name)) {
+        throw NameError("Function not found: " + function_name);
+    }
+    return run(name, args);
 }
 
-FunctionDefAST* Environment::getFunction(const std::string& name) {
-    auto it = functions.find(name);
-    if (it != functions.end()) {
-        return it->second.get();
+Value ExecutionContext::run(Symbol name, const std::vector<Value>& args) {
+    RuntimeStats::Scope scope(stats);
+    budget.start();
+    if (engine == Engine::TreeWalker) {
+        return runTreeWalker(name, args);
     }
-    
-    if (parent) {
-        return parent->getFunction(name);
+    return vm.run(name, args);
+}
+
+void ExecutionContext::runColumns(const std::string& function_name, const std::vector<const int64_t*>& args,
+                                  size_t rows, int64_t* results) {
+    Symbol name;
+    const FlatFunction* func = nullptr;
+    if (program->lookup(function_name, name)) {
+        func = program->getGlobalEnvironment().getFunction(name);
+    }
+    if (!func) {
+        throw NameError("Function not found: " + function_name);
+    }
+    if (func->paramCount != args.size()) {
+        throw RuntimeError("Incorrect number of arguments for function: " + function_name);
     }
     
-    return nullptr;
+    RuntimeStats::Scope scope(stats);
+    LaneEvaluator(*func, name, *this).run(args, rows, results);
 }
 
-std::unique_ptr<Environment> Environment::createChildEnv() {
-    return std::make_unique<Environment>(this);
+void ExecutionContext::setLimits(const RunLimits& limits) {
+    budget.setLimits(limits);
+    if (limits.any()) {
+        vm.setJit(nullptr);
+    }
 }
 
+void ExecutionContext::enableMemoization(size_t capacity) {
+    memo = std::make_unique<MemoCache>(capacity);
+    vm.setMemoCache(memo.get());
+    vm.setJit(nullptr);
+}
 
-Interpreter::Interpreter(std::istream& input) : global_env(std::make_unique<Environment>()) {
-
-    Tokenizer tokenizer(&input);
-    
+namespace {
 
-    Parser parser(&tokenizer);
-    
+// Nested functions are named after the functions that define them, so that
+// the many `helper`s of a script can be told apart.
+void nameFunctions(Profiler& profiler, const FlatFunction& func, const std::string& prefix) {
+    std::string name = prefix + symbolName(func.name);
+    profiler.setName(&func, name);
+    for (const FlatFunction& nested : func.nested) {
+        nameFunctions(profiler, nested, name + ".");
+    }
+}
 
-    functions = parser.parseProgram();
-    
+void nameFunctions(Profiler& profiler, const CompiledFunction& function, const std::string& prefix) {
+    std::string name = prefix + symbolName(function.name);
+    profiler.setName(&function, name);
+    for (const auto& nested : function.nested) {
+        nameFunctions(profiler, *nested, name + ".");
+    }
+}
 
-    for (auto& func : functions) {
- 
-        std::string name = func->getName();
-        std::vector<std::string> params = func->getParams(); 
-        
+}
 
-        auto new_func = std::make_unique<FunctionDefAST>(
-            name,
-            std::move(params),
-            std::vector<std::unique_ptr<StatementAST>>(), 
-            nullptr  
-        );
-        
-        global_env->defineFunction(func->getName(), func->clone());
+void ExecutionContext::enableProfiling() {
+    profiler = std::make_unique<Profiler>();
+    if (engine == Engine::TreeWalker) {
+        for (const FlatFunction& func : program->getFlatProgram().getFunctions()) {
+            nameFunctions(*profiler, func, "");
+        }
+    } else {
+        for (const auto& function : program->getCompiled()) {
+            nameFunctions(*profiler, *function, "");
+        }
     }
+    vm.setProfiler(profiler.get());
+    vm.setJit(nullptr);
 }
 
-int Interpreter::run(const std::string& function_name, std::vector<int> args) {
-    auto func = global_env->getFunction(function_name);
+Value ExecutionContext::runTreeWalker(Symbol name, const std::vector<Value>& args) {
+    Environment& globals = program->getGlobalEnvironment();
+    
+    const FlatFunction* func = globals.getFunction(name);
     if (!func) {
-        throw NameError("Function not found: " + function_name);
+        throw NameError("Function not found: " + symbolName(name));
     }
     
-    if (func->getParams().size() != args.size()) {
-        throw RuntimeError("Incorrect number of arguments for function: " + function_name);
+    if (func->paramCount != args.size()) {
+        throw RuntimeError("Incorrect number of arguments for function: " + symbolName(name));
     }
     
-    auto funcEnv = global_env->createChildEnv();
+    auto funcEnv = globals.createChildEnv(&globals, func->frameSize);
     
     for (size_t i = 0; i < args.size(); i++) {
-        funcEnv->defineVariable(func->getParams()[i], 
-            std::make_unique<IntValue>(args[i]));
+        funcEnv->defineVariable(static_cast<int>(i), args[i]);
     }
     
-    Evaluator evaluator(*funcEnv);
-    
-    for (const auto& stmt : func->getBody()) {
-        evaluator.evaluate(stmt.get());
+    if (!treeState) {
+        treeState = std::make_unique<EvaluatorState>(program->getFlatProgram(), globals, budget);
     }
+    treeState->memo = memo.get();
+    treeState->profiler = profiler.get();
+    
+    char marker;
+    treeState->stackLimit = vm.getStackLimit();
+    treeState->stackUsed = 0;
+    treeState->useStack(reinterpret_cast<uintptr_t>(&marker));
     
-    auto result = evaluator.evaluate(func->getReturnExpr());
-    if (!result) {
+    Value result = Evaluator::callFunction(func, std::move(funcEnv), *treeState);
+    if (result.isNil()) {
         throw RuntimeError("Function did not return a value");
     }
     
-    return result->asInt();
-}
\ No newline at end of file
+    return result;
+}
+
+
+Interpreter::Interpreter(std::istream& input, Engine engine, bool optimize)
+    : program(std::make_shared<const Program>(input, optimize)), context(program, engine) {}
+
+Interpreter::Interpreter(std::string_view source, Engine engine, bool optimize)
+    : program(std::make_shared<const Program>(source, optimize)), context(program, engine) {}
+
+Interpreter::Interpreter(std::shared_ptr<const Program> program, Engine engine)
+    : program(std::move(program)), context(this->program, engine) {}
+
+Value Interpreter::run(const std::string& function_name, const std::vector<Value>& args) {
+    return context.run(function_name, args);
+}
+
+void Interpreter::runColumns(const std::string& function_name, const std::vector<const int64_t*>& args, size_t rows,
+                             int64_t* results) {
+    context.runColumns(function_name, args, rows, results);
+}
+
+std::vector<BatchResult> Interpreter::runBatch(const std::string& function_name, const std::vector<std::vector<Value>>& args) {
+    std::vector<BatchResult> results(args.size());
+    
+    Symbol name;
+    if (!program->lookup(function_name, name)) {
+        auto error = std::make_exception_ptr(NameError("Function not found: " + function_name));
+        for (BatchResult& result : results) {
+            result.error = error;
+        }
+        return results;
+    }
+    
+    startWorkers();
+    
+    // Several ranges per thread leave room for stealing when items differ
+    // in cost; the cap keeps ranges short enough to rebalance late in the run.
+    size_t grain = std::min<size_t>(1024, args.size() / (pool->size() * 8));
+    
+    pool->parallelFor(args.size(), grain, [&](size_t index, size_t begin, size_t end) {
+        ExecutionContext& worker = *workers[index];
+        for (size_t i = begin; i < end; i++) {
+            try {
+                results[i].value = worker.run(name, args[i]);
+            } catch (...) {
+                results[i].error = std::current_exception();
+            }
+        }
+    });
+    
+    return results;
+}
+
+void Interpreter::setThreadCount(size_t count) {
+    threadCount = count;
+    pool.reset();
+    workers.clear();
+}
+
+void Interpreter::startWorkers() {
+    if (!pool) {
+        pool = std::make_unique<ThreadPool>(threadCount);
+    }
+    
+    while (workers.size() < pool->size()) {
+        auto worker = std::make_unique<ExecutionContext>(program, context.getEngine());
+        if (const MemoCache* memo = context.getMemoCache()) {
+            worker->enableMemoization(memo->getCapacity());
+        }
+        if (context.getProfiler()) {
+            worker->enableProfiling();
+        }
+        worker->setLimits(context.getLimits());
+        worker->setStackLimit(context.getStackLimit());
+        workers.push_back(std::move(worker));
+    }
+}
+
+void Interpreter::enableMemoization(size_t capacity) {
+    context.enableMemoization(capacity);
+    workers.clear();
+}
+
+void Interpreter::enableProfiling() {
+    context.enableProfiling();
+    workers.clear();
+}
+
+void Interpreter::setLimits(const RunLimits& limits) {
+    context.setLimits(limits);
+    workers.clear();
+}
+
+void Interpreter::setStackLimit(size_t bytes) {
+    context.setStackLimit(bytes);
+    workers.clear();
+}
+
+RuntimeStats Interpreter::getStats() const {
+    RuntimeStats total = context.getStats();
+    for (const auto& worker : workers) {
+        total.merge(worker->getStats());
+    }
+    return total;
+}
+
+Profiler Interpreter::getProfile() const {
+    Profiler profile;
+    if (const Profiler* own = context.getProfiler()) {
+        profile.merge(*own);
+    }
+    for (const auto& worker : workers) {
+        if (const Profiler* profiler = worker->getProfiler()) {
+            profile.merge(*profiler);
+        }
+    }
+    return profile;
+}
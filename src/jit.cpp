@@ -0,0 +1,796 @@
+#include "jit.h"
+#include "program.h"
+#include "error.h"
+#include "native_stack.h"
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <set>
+#include <unordered_map>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define TOY_JIT_X86_64
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+#ifdef TOY_JIT_X86_64
+
+// Native functions follow the System V calling convention: the context in
+// rdi, then the arguments as 64-bit integers. Nested functions take the
+// frame pointer of the function that defined them in rsi, ahead of their
+// arguments, so that they can read its slots.
+constexpr size_t MAX_PARAMS = 5;
+constexpr size_t MAX_NESTED_PARAMS = 4;
+
+// Native code cannot throw through its own frames, so an error is stored
+// in the context, every frame returns on seeing it, and JitModule::call
+// raises it on the C++ side. OVERFLOW and STACK_OVERFLOW are not errors of
+// the program: a result needs a BigInt, or the recursion more stack than
+// the thread has, and the VM has both.
+enum class JitError : int32_t { NONE, DIVISION_BY_ZERO, STACK_OVERFLOW, OVERFLOW };
+
+struct JitContext {
+    int32_t error;
+    uintptr_t stackLimit;  // the prologue fails calls that would go below it
+};
+
+static_assert(offsetof(JitContext, error) == 0, "the generated code reads error at [rbx]");
+static_assert(offsetof(JitContext, stackLimit) == 8, "the generated code reads stackLimit at [rbx + 8]");
+
+using NativeFunction = int64_t (*)(JitContext*, int64_t, int64_t, int64_t, int64_t, int64_t);
+
+enum Reg : uint8_t { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9 };
+
+enum Condition : uint8_t { OVERFLOWS = 0x0, BELOW = 0x2, EQUAL = 0x4, NOT_EQUAL = 0x5, LESS = 0xC, GREATER_EQUAL = 0xD };
+
+const Reg ARG_REGS[MAX_PARAMS] = {RSI, RDX, RCX, R8, R9};
+const Reg NESTED_ARG_REGS[MAX_NESTED_PARAMS] = {RDX, RCX, R8, R9};
+
+// Emits the handful of instructions the code generator needs. Operands are
+// 64-bit, and jumps always take a 32-bit displacement so that labels can be
+// bound after they are used.
+class Assembler {
+    std::vector<uint8_t> code;
+    std::vector<size_t> labels;
+    std::vector<std::pair<size_t, size_t>> fixups;  // displacement offset, label
+
+public:
+    static constexpr size_t UNBOUND = SIZE_MAX;
+
+    const std::vector<uint8_t>& getCode() const { return code; }
+
+    size_t newLabel() {
+        labels.push_back(UNBOUND);
+        return labels.size() - 1;
+    }
+    void bind(size_t label) { labels[label] = code.size(); }
+    size_t offsetOf(size_t label) const { return labels[label]; }
+
+    void resolve() {
+        for (const auto& [at, label] : fixups) {
+            int32_t displacement = static_cast<int32_t>(labels[label] - (at + 4));
+            std::memcpy(&code[at], &displacement, 4);
+        }
+        fixups.clear();
+    }
+
+    void push(Reg reg) {
+        rex(false, 0, reg);
+        byte(0x50 + (reg & 7));
+    }
+    void pop(Reg reg) {
+        rex(false, 0, reg);
+        byte(0x58 + (reg & 7));
+    }
+
+    // The shortest encoding: a 32-bit move zero-extends, one with a 32-bit
+    // immediate sign-extends, and anything else takes all 64 bits.
+    void movImm(Reg reg, int64_t value) {
+        if (value >= 0 && value <= INT32_MAX) {
+            rex(false, 0, reg);
+            byte(0xB8 + (reg & 7));
+            int32(static_cast<int32_t>(value));
+        } else if (value >= INT32_MIN && value < 0) {
+            rex(true, 0, reg);
+            bytes({0xC7, static_cast<uint8_t>(0xC0 | (reg & 7))});
+            int32(static_cast<int32_t>(value));
+        } else {
+            rex(true, 0, reg);
+            byte(0xB8 + (reg & 7));
+            uint8_t raw[8];
+            std::memcpy(raw, &value, 8);
+            code.insert(code.end(), raw, raw + 8);
+        }
+    }
+    void load(Reg reg, Reg base, int32_t disp) { memory(true, 0x8B, reg, base, disp); }
+    void store(Reg base, int32_t disp, Reg reg) { memory(true, 0x89, reg, base, disp); }
+    void mov(Reg dst, Reg src) { registers(true, 0x89, src, dst); }
+
+    void add(Reg dst, Reg src) { registers(true, 0x01, src, dst); }
+    void sub(Reg dst, Reg src) { registers(true, 0x29, src, dst); }
+    void cmp(Reg dst, Reg src) { registers(true, 0x39, src, dst); }
+    void cmpMinusOne(Reg reg) {
+        rex(true, 0, reg);
+        bytes({0x83, static_cast<uint8_t>(0xF8 | (reg & 7)), 0xFF});
+    }
+    void test(Reg dst, Reg src) { registers(true, 0x85, src, dst); }
+    void neg(Reg reg) { registers(true, 0xF7, 3, reg); }
+    void imul(Reg dst, Reg src) {
+        rex(true, dst, src);
+        bytes({0x0F, 0xAF, static_cast<uint8_t>(0xC0 | ((dst & 7) << 3) | (src & 7))});
+    }
+    // rdx:rax / src, quotient in rax
+    void idiv(Reg src) {
+        bytes({0x48, 0x99});
+        registers(true, 0xF7, 7, src);
+    }
+    // rax = condition ? 1 : 0
+    void setFlag(Condition cc) {
+        bytes({0x0F, static_cast<uint8_t>(0x90 + cc), 0xC0});
+        bytes({0x0F, 0xB6, 0xC0});
+    }
+
+    void subRsp(int32_t amount) {
+        bytes({0x48, 0x81, 0xEC});
+        int32(amount);
+    }
+    void cmpRspStackLimit() { bytes({0x48, 0x3B, 0x63, 0x08}); }
+    void cmpErrorZero() { bytes({0x83, 0x3B, 0x00}); }
+    void setError(JitError error) {
+        bytes({0xC7, 0x03});
+        int32(static_cast<int32_t>(error));
+    }
+    void leave() { byte(0xC9); }
+    void ret() { byte(0xC3); }
+
+    void jump(size_t label) {
+        byte(0xE9);
+        fixup(label);
+    }
+    void jumpIf(Condition cc, size_t label) {
+        bytes({0x0F, static_cast<uint8_t>(0x80 + cc)});
+        fixup(label);
+    }
+    void call(size_t label) {
+        byte(0xE8);
+        fixup(label);
+    }
+
+private:
+    void byte(uint8_t value) { code.push_back(value); }
+    void bytes(std::initializer_list<uint8_t> values) { code.insert(code.end(), values); }
+    void int32(int32_t value) {
+        uint8_t raw[4];
+        std::memcpy(raw, &value, 4);
+        code.insert(code.end(), raw, raw + 4);
+    }
+    void fixup(size_t label) {
+        fixups.emplace_back(code.size(), label);
+        int32(0);
+    }
+
+    void rex(bool wide, uint8_t reg, uint8_t rm) {
+        uint8_t prefix = 0x40 | (wide ? 0x08 : 0) | ((reg & 8) ? 0x04 : 0) | ((rm & 8) ? 0x01 : 0);
+        if (prefix != 0x40) {
+            byte(prefix);
+        }
+    }
+    void registers(bool wide, uint8_t opcode, uint8_t reg, uint8_t rm) {
+        rex(wide, reg, rm);
+        bytes({opcode, static_cast<uint8_t>(0xC0 | ((reg & 7) << 3) | (rm & 7))});
+    }
+    // [base + disp32]; base is never rsp or r12, which would need a SIB byte
+    void memory(bool wide, uint8_t opcode, uint8_t reg, uint8_t base, int32_t disp) {
+        rex(wide, reg, base);
+        bytes({opcode, static_cast<uint8_t>(0x80 | ((reg & 7) << 3) | (base & 7))});
+        int32(disp);
+    }
+};
+
+// The whole program as far as native code is concerned.
+struct Plan {
+    const std::vector<FunctionDefAST*>& functions;
+    std::map<Symbol, size_t> globals;  // the definition a top-level name resolves to
+    std::set<Symbol> nestedNames;      // names some function defines, anywhere
+    std::unordered_map<const FunctionCallAST*, const FunctionDefAST*> targets;
+
+    explicit Plan(const std::vector<FunctionDefAST*>& functions) : functions(functions) {}
+};
+
+// Decides whether a top-level function can be compiled by itself, and
+// resolves each of its calls on the way. It is only compiled once every
+// top-level function it calls can be compiled too.
+class Support : public Visitor {
+    Plan& plan;
+    bool supported = true;
+    std::set<size_t> callees;
+
+    bool inNested = false;
+    std::vector<bool> bound;       // slots of the top-level function assigned so far
+    std::vector<bool> outerBound;  // ... when the nested function being checked was defined
+    std::map<Symbol, const FunctionDefAST*> visible;
+
+public:
+    explicit Support(Plan& plan) : plan(plan) {}
+
+    bool check(const FunctionDefAST& func) {
+        if (func.getParams().size() > MAX_PARAMS) {
+            return false;
+        }
+        bound.assign(func.getFrameSize(), false);
+        for (size_t i = 0; i < func.getParams().size(); i++) {
+            bound[i] = true;
+        }
+        checkBody(func);
+        return supported;
+    }
+
+    const std::set<size_t>& getCallees() const { return callees; }
+
+    void visit(ExprAST& expr) override {
+        (void)expr;
+        supported = false;
+    }
+
+    void visit(NumberAST& number) override {
+        if (number.isBig()) {
+            supported = false;
+        }
+    }
+
+    void visit(IdentifierAST& identifier) override {
+        int depth = identifier.getDepth();
+        if (depth == 0) {
+            return;
+        }
+        // A nested function may only read slots that were assigned before
+        // it was defined; any other read could find them unset.
+        size_t slot = static_cast<size_t>(identifier.getSlot());
+        if (depth != 1 || !inNested || slot >= outerBound.size() || !outerBound[slot]) {
+            supported = false;
+        }
+    }
+
+    void visit(BinaryOpAST& binary) override {
+        switch (binary.getOp()) {
+            case '+': case '-': case '*': case '/': case '=': case '!': case '<':
+                break;
+            default:
+                supported = false;
+        }
+        binary.getLeft()->accept(*this);
+        binary.getRight()->accept(*this);
+    }
+
+    void visit(TernaryExprAST& ternary) override {
+        ternary.getCondition()->accept(*this);
+        ternary.getThenExpr()->accept(*this);
+        ternary.getElseExpr()->accept(*this);
+    }
+
+    void visit(FunctionCallAST& call) override {
+        for (ExprAST* arg : call.getArgs()) {
+            arg->accept(*this);
+        }
+
+        // Functions are found through the callers at run time. A name that
+        // no function defines as nested can only find its top-level
+        // definition, and a nested function that has been defined is found
+        // in the frame of its definer before anything else.
+        const FunctionDefAST* target = nullptr;
+        Symbol callee = call.getCallee();
+        auto it = visible.find(callee);
+        if (it != visible.end()) {
+            target = it->second;
+        } else if (!plan.nestedNames.count(callee) && plan.globals.count(callee)) {
+            size_t index = plan.globals[callee];
+            target = plan.functions[index];
+            callees.insert(index);
+        }
+
+        if (!target || target->getParams().size() != call.getArgs().size()) {
+            supported = false;
+            return;
+        }
+        plan.targets[&call] = target;
+    }
+
+    void visit(StatementAST& stmt) override {
+        (void)stmt;
+        supported = false;
+    }
+
+    void visit(AssignmentAST& assignment) override {
+        assignment.getValue()->accept(*this);
+        if (!inNested) {
+            bound[static_cast<size_t>(assignment.getSlot())] = true;
+        }
+    }
+
+    void visit(ReturnStmtAST& returnStmt) override {
+        returnStmt.getReturnExpr()->accept(*this);
+    }
+
+    void visit(FunctionDefAST& functionDef) override {
+        // A second definition of the same name would change what calls in
+        // the first one find, and deeper nesting needs more than one link.
+        if (inNested || visible.count(functionDef.getName()) ||
+            functionDef.getParams().size() > MAX_NESTED_PARAMS) {
+            supported = false;
+            return;
+        }
+        visible[functionDef.getName()] = &functionDef;
+
+        inNested = true;
+        outerBound = bound;
+        checkBody(functionDef);
+        inNested = false;
+    }
+
+private:
+    void checkBody(const FunctionDefAST& func) {
+        for (StatementAST* stmt : func.getBody()) {
+            stmt->accept(*this);
+        }
+        if (func.getReturnExpr()) {
+            func.getReturnExpr()->accept(*this);
+        } else {
+            supported = false;
+        }
+    }
+};
+
+void collectNestedNames(const FunctionDefAST& func, std::set<Symbol>& names) {
+    for (StatementAST* stmt : func.getBody()) {
+        if (auto nested = dynamic_cast<const FunctionDefAST*>(stmt)) {
+            names.insert(nested->getName());
+            collectNestedNames(*nested, names);
+        }
+    }
+}
+
+// Translates one supported function at a time. Values live in rax; the
+// left operand of a binary operator and call arguments wait on the machine
+// stack while the rest is evaluated. Frames look like this:
+//
+//   [rbp + 8]            return address
+//   [rbp]                caller's rbp
+//   [rbp - 8]            caller's rbx
+//   [rbp - 16]           defining frame's rbp (nested functions only)
+//   [rbp - base - 8*i]   slot i
+//
+// rbx holds the context throughout.
+class CodeGenerator : public Visitor {
+    Assembler& as;
+    const Plan& plan;
+    const std::unordered_map<const FunctionDefAST*, size_t>& entries;
+    size_t exitLabel;
+    size_t divisionByZeroLabel;
+    size_t stackOverflowLabel;
+    size_t overflowLabel;
+
+    const FunctionDefAST* function = nullptr;
+    bool nested = false;
+    bool definesFunctions = false;
+    bool tailPosition = false;
+    size_t bodyLabel = 0;
+
+public:
+    CodeGenerator(Assembler& as, const Plan& plan, const std::unordered_map<const FunctionDefAST*, size_t>& entries)
+        : as(as), plan(plan), entries(entries), exitLabel(as.newLabel()), divisionByZeroLabel(as.newLabel()),
+          stackOverflowLabel(as.newLabel()), overflowLabel(as.newLabel()) {}
+
+    // Emits `func` and the functions it defines.
+    void generate(const FunctionDefAST& func, bool isNested) {
+        function = &func;
+        nested = isNested;
+        definesFunctions = false;
+        std::vector<const FunctionDefAST*> inner;
+        for (StatementAST* stmt : func.getBody()) {
+            if (auto def = dynamic_cast<const FunctionDefAST*>(stmt)) {
+                definesFunctions = true;
+                inner.push_back(def);
+            }
+        }
+
+        as.bind(entries.at(&func));
+        as.push(RBP);
+        as.mov(RBP, RSP);
+        as.push(RBX);
+        as.mov(RBX, RDI);
+        if (nested) {
+            as.push(RSI);
+        }
+        // Keeps rsp 16-byte aligned, as if this were compiled C.
+        size_t slots = func.getFrameSize() + (nested ? 1 : 0);
+        as.subRsp(static_cast<int32_t>(8 * (func.getFrameSize() + (slots % 2 == 0 ? 1 : 0))));
+        as.cmpRspStackLimit();
+        as.jumpIf(BELOW, stackOverflowLabel);
+
+        const Reg* args = nested ? NESTED_ARG_REGS : ARG_REGS;
+        for (size_t i = 0; i < func.getParams().size(); i++) {
+            as.store(RBP, slotOffset(i), args[i]);
+        }
+
+        bodyLabel = as.newLabel();
+        as.bind(bodyLabel);
+        for (StatementAST* stmt : func.getBody()) {
+            stmt->accept(*this);
+        }
+        tailPosition = true;
+        func.getReturnExpr()->accept(*this);
+        tailPosition = false;
+
+        as.load(RBX, RBP, -8);
+        as.leave();
+        as.ret();
+
+        for (const FunctionDefAST* def : inner) {
+            generate(*def, true);
+        }
+    }
+
+    // The shared ways out of a frame on error.
+    void generateExits() {
+        as.bind(divisionByZeroLabel);
+        as.setError(JitError::DIVISION_BY_ZERO);
+        as.jump(exitLabel);
+
+        as.bind(overflowLabel);
+        as.setError(JitError::OVERFLOW);
+        as.jump(exitLabel);
+
+        as.bind(stackOverflowLabel);
+        as.setError(JitError::STACK_OVERFLOW);
+
+        as.bind(exitLabel);
+        as.load(RBX, RBP, -8);
+        as.leave();
+        as.ret();
+    }
+
+    void visit(ExprAST& expr) override {
+        (void)expr;
+        throw RuntimeError("Cannot compile untyped expression");
+    }
+
+    void visit(NumberAST& number) override { as.movImm(RAX, number.getValue().asInt()); }
+
+    void visit(IdentifierAST& identifier) override { loadOperand(RAX, identifier); }
+
+    void visit(BinaryOpAST& binary) override {
+        tailPosition = false;
+        evaluateOperands(binary);
+        switch (binary.getOp()) {
+            case '+':
+                as.add(RAX, RCX);
+                as.jumpIf(OVERFLOWS, overflowLabel);
+                break;
+            case '-':
+                as.sub(RAX, RCX);
+                as.jumpIf(OVERFLOWS, overflowLabel);
+                break;
+            case '*':
+                as.imul(RAX, RCX);
+                as.jumpIf(OVERFLOWS, overflowLabel);
+                break;
+            case '/': {
+                // idiv faults on the one quotient that overflows, so
+                // dividing by -1 negates instead.
+                size_t divide = as.newLabel();
+                size_t done = as.newLabel();
+                as.test(RCX, RCX);
+                as.jumpIf(EQUAL, divisionByZeroLabel);
+                as.cmpMinusOne(RCX);
+                as.jumpIf(NOT_EQUAL, divide);
+                as.neg(RAX);
+                as.jumpIf(OVERFLOWS, overflowLabel);
+                as.jump(done);
+                as.bind(divide);
+                as.idiv(RCX);
+                as.bind(done);
+                break;
+            }
+            case '=': as.cmp(RAX, RCX); as.setFlag(EQUAL); break;
+            case '!': as.cmp(RAX, RCX); as.setFlag(NOT_EQUAL); break;
+            case '<': as.cmp(RAX, RCX); as.setFlag(LESS); break;
+        }
+    }
+
+    void visit(TernaryExprAST& ternary) override {
+        bool tail = tailPosition;
+        tailPosition = false;
+        size_t otherwise = as.newLabel();
+        size_t end = as.newLabel();
+
+        // A comparison branches on the flags directly rather than on its
+        // 0 or 1.
+        auto compare = dynamic_cast<BinaryOpAST*>(ternary.getCondition());
+        char op = compare ? compare->getOp() : 0;
+        if (op == '=' || op == '!' || op == '<') {
+            evaluateOperands(*compare);
+            as.cmp(RAX, RCX);
+            as.jumpIf(op == '=' ? NOT_EQUAL : op == '!' ? EQUAL : GREATER_EQUAL, otherwise);
+        } else {
+            ternary.getCondition()->accept(*this);
+            as.test(RAX, RAX);
+            as.jumpIf(EQUAL, otherwise);
+        }
+
+        tailPosition = tail;
+        ternary.getThenExpr()->accept(*this);
+        as.jump(end);
+
+        as.bind(otherwise);
+        tailPosition = tail;
+        ternary.getElseExpr()->accept(*this);
+        as.bind(end);
+        tailPosition = false;
+    }
+
+    void visit(FunctionCallAST& call) override {
+        // As in the VM, a frame that defined functions is never replaced.
+        bool tail = tailPosition && !definesFunctions;
+        tailPosition = false;
+
+        for (ExprAST* arg : call.getArgs()) {
+            arg->accept(*this);
+            as.push(RAX);
+        }
+
+        const FunctionDefAST* target = plan.targets.at(&call);
+        size_t argc = call.getArgs().size();
+
+        if (tail && target == function) {
+            for (size_t i = argc; i-- > 0;) {
+                as.pop(RAX);
+                as.store(RBP, slotOffset(i), RAX);
+            }
+            as.jump(bodyLabel);
+            return;
+        }
+
+        bool targetNested = !isTopLevel(target);
+        const Reg* args = targetNested ? NESTED_ARG_REGS : ARG_REGS;
+        for (size_t i = argc; i-- > 0;) {
+            as.pop(args[i]);
+        }
+        if (targetNested) {
+            // Siblings and recursive calls share the link of the caller;
+            // calls from the definer pass its own frame.
+            if (nested) {
+                as.load(RSI, RBP, -16);
+            } else {
+                as.mov(RSI, RBP);
+            }
+        }
+        as.mov(RDI, RBX);
+
+        if (tail) {
+            as.load(RBX, RBP, -8);
+            as.leave();
+            as.jump(entries.at(target));
+            return;
+        }
+        as.call(entries.at(target));
+        as.cmpErrorZero();
+        as.jumpIf(NOT_EQUAL, exitLabel);
+    }
+
+    void visit(StatementAST& stmt) override {
+        (void)stmt;
+        throw RuntimeError("Cannot compile untyped statement");
+    }
+
+    void visit(AssignmentAST& assignment) override {
+        assignment.getValue()->accept(*this);
+        as.store(RBP, slotOffset(static_cast<size_t>(assignment.getSlot())), RAX);
+    }
+
+    void visit(ReturnStmtAST& returnStmt) override { returnStmt.getReturnExpr()->accept(*this); }
+
+    void visit(FunctionDefAST& functionDef) override {
+        // Generated after its definer; defining it at run time is a no-op
+        // since every call to it is already resolved.
+        (void)functionDef;
+    }
+
+private:
+    int32_t slotOffset(size_t slot) const {
+        return -static_cast<int32_t>((nested ? 24 : 16) + 8 * slot);
+    }
+
+    bool isTopLevel(const FunctionDefAST* func) const {
+        auto it = plan.globals.find(func->getName());
+        return it != plan.globals.end() && plan.functions[it->second] == func;
+    }
+
+    static bool isOperand(ExprAST* expr) {
+        return dynamic_cast<NumberAST*>(expr) || dynamic_cast<IdentifierAST*>(expr);
+    }
+
+    void loadOperand(Reg reg, ExprAST& expr) {
+        if (auto number = dynamic_cast<NumberAST*>(&expr)) {
+            as.movImm(reg, number->getValue().asInt());
+            return;
+        }
+        auto& identifier = static_cast<IdentifierAST&>(expr);
+        size_t slot = static_cast<size_t>(identifier.getSlot());
+        if (identifier.getDepth() == 0) {
+            as.load(reg, RBP, slotOffset(slot));
+        } else {
+            as.load(RCX, RBP, -16);
+            as.load(reg, RCX, -static_cast<int32_t>(16 + 8 * slot));
+        }
+    }
+
+    // Leaves the left operand in rax and the right one in rcx.
+    void evaluateOperands(BinaryOpAST& binary) {
+        binary.getLeft()->accept(*this);
+        if (isOperand(binary.getRight())) {
+            loadOperand(RCX, *binary.getRight());
+            return;
+        }
+        as.push(RAX);
+        binary.getRight()->accept(*this);
+        as.mov(RCX, RAX);
+        as.pop(RAX);
+    }
+};
+
+// Native frames are much smaller than the VM's, so a runaway recursion
+// gets to the end of the stack.
+uintptr_t stackLimit() {
+    uintptr_t low = nativeStackLow();
+    return low ? low + NATIVE_STACK_RESERVE : 0;
+}
+
+#endif
+
+}
+
+bool JitModule::isSupported() {
+#ifdef TOY_JIT_X86_64
+    return true;
+#else
+    return false;
+#endif
+}
+
+JitModule::JitModule(const Program& program) {
+#ifdef TOY_JIT_X86_64
+    const auto& functions = program.getFunctions();
+    Plan plan(functions);
+    for (size_t i = 0; i < functions.size(); i++) {
+        plan.globals[functions[i]->getName()] = i;
+        collectNestedNames(*functions[i], plan.nestedNames);
+    }
+
+    std::vector<bool> supported(functions.size());
+    std::vector<std::set<size_t>> callees(functions.size());
+    for (size_t i = 0; i < functions.size(); i++) {
+        Support support(plan);
+        supported[i] = support.check(*functions[i]);
+        callees[i] = support.getCallees();
+    }
+
+    // Calling something the VM has to run rules a function out; repeat
+    // until nothing changes so that mutual recursion settles.
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 0; i < functions.size(); i++) {
+            if (!supported[i]) {
+                continue;
+            }
+            for (size_t callee : callees[i]) {
+                if (!supported[callee]) {
+                    supported[i] = false;
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    Assembler as;
+    std::unordered_map<const FunctionDefAST*, size_t> labels;
+    auto assignLabels = [&](const FunctionDefAST& func, auto& self) -> void {
+        labels[&func] = as.newLabel();
+        for (StatementAST* stmt : func.getBody()) {
+            if (auto nested = dynamic_cast<const FunctionDefAST*>(stmt)) {
+                self(*nested, self);
+            }
+        }
+    };
+    for (size_t i = 0; i < functions.size(); i++) {
+        if (supported[i]) {
+            assignLabels(*functions[i], assignLabels);
+        }
+    }
+    if (labels.empty()) {
+        return;
+    }
+
+    CodeGenerator generator(as, plan, labels);
+    for (size_t i = 0; i < functions.size(); i++) {
+        if (supported[i]) {
+            generator.generate(*functions[i], false);
+        }
+    }
+    generator.generateExits();
+    as.resolve();
+
+    // Written while writable, then made executable and never written again.
+    const std::vector<uint8_t>& code = as.getCode();
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size = (code.size() + page - 1) / page * page;
+    void* mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED) {
+        size = 0;
+        return;
+    }
+    std::memcpy(mapped, code.data(), code.size());
+    if (mprotect(mapped, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(mapped, size);
+        size = 0;
+        return;
+    }
+    memory = mapped;
+
+    const auto& compiled = program.getCompiled();
+    for (size_t i = 0; i < functions.size(); i++) {
+        if (supported[i]) {
+            entries[compiled[i].get()] = static_cast<const uint8_t*>(memory) + as.offsetOf(labels[functions[i]]);
+        }
+    }
+#else
+    (void)program;
+#endif
+}
+
+JitModule::~JitModule() {
+#ifdef TOY_JIT_X86_64
+    if (memory) {
+        munmap(memory, size);
+    }
+#endif
+}
+
+bool JitModule::call(const void* code, const Value* args, size_t argc, Value& result) const {
+#ifdef TOY_JIT_X86_64
+    JitContext context{static_cast<int32_t>(JitError::NONE), stackLimit()};
+    int64_t values[MAX_PARAMS] = {};
+    for (size_t i = 0; i < argc && i < MAX_PARAMS; i++) {
+        if (args[i].isBig()) {
+            return false;
+        }
+        values[i] = args[i].asInt();
+    }
+
+    // Arguments beyond those the function takes are passed in registers it
+    // never reads, so one signature serves every arity.
+    auto function = reinterpret_cast<NativeFunction>(const_cast<void*>(code));
+    int64_t value = function(&context, values[0], values[1], values[2], values[3], values[4]);
+
+    switch (static_cast<JitError>(context.error)) {
+        case JitError::DIVISION_BY_ZERO:
+            throw RuntimeError("Division by zero");
+        case JitError::STACK_OVERFLOW:
+        case JitError::OVERFLOW:
+            return false;
+        default:
+            result = Value(value);
+            return true;
+    }
+#else
+    (void)code;
+    (void)args;
+    (void)argc;
+    (void)result;
+    throw RuntimeError("Native code is not supported on this platform");
+#endif
+}
@@ -0,0 +1,374 @@
+#include "lanes.h"
+#include "interpreter.h"
+#include "error.h"
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define TOY_LANES_SSE2
+#include <emmintrin.h>
+#endif
+
+// AVX2 code is compiled alongside the baseline and only run on CPUs that
+// have it, which needs the GCC and Clang target attribute.
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define TOY_LANES_AVX2
+#include <immintrin.h>
+#endif
+
+namespace {
+
+constexpr size_t WIDTH = LaneEvaluator::WIDTH;
+
+// Each kernel computes all WIDTH lanes, whether active or not; what it
+// returns is the mask of lanes that overflowed or failed.
+
+#ifdef TOY_LANES_AVX2
+
+bool hasAvx2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+
+__attribute__((target("avx2")))
+uint64_t addOrSubtractAvx2(const int64_t* left, const int64_t* right, int64_t* out, bool subtract) {
+    uint64_t overflow = 0;
+    for (size_t i = 0; i < WIDTH; i += 4) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(left + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(right + i));
+        __m256i result = subtract ? _mm256_sub_epi64(a, b) : _mm256_add_epi64(a, b);
+        // The sign of the result is wrong exactly when the operation overflowed.
+        __m256i wrong = subtract ? _mm256_and_si256(_mm256_xor_si256(a, b), _mm256_xor_si256(a, result))
+                                 : _mm256_and_si256(_mm256_xor_si256(a, result), _mm256_xor_si256(b, result));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), result);
+        overflow |= static_cast<uint64_t>(_mm256_movemask_pd(_mm256_castsi256_pd(wrong))) << i;
+    }
+    return overflow;
+}
+
+__attribute__((target("avx2")))
+void compareAvx2(char op, const int64_t* left, const int64_t* right, int64_t* out) {
+    const __m256i one = _mm256_set1_epi64x(1);
+    for (size_t i = 0; i < WIDTH; i += 4) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(left + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(right + i));
+        __m256i truth = op == '<' ? _mm256_cmpgt_epi64(b, a) : _mm256_cmpeq_epi64(a, b);
+        truth = op == '!' ? _mm256_andnot_si256(truth, one) : _mm256_and_si256(truth, one);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), truth);
+    }
+}
+
+__attribute__((target("avx2")))
+uint64_t nonzeroAvx2(const int64_t* values) {
+    uint64_t zero = 0;
+    for (size_t i = 0; i < WIDTH; i += 4) {
+        __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+        __m256i isZero = _mm256_cmpeq_epi64(value, _mm256_setzero_si256());
+        zero |= static_cast<uint64_t>(_mm256_movemask_pd(_mm256_castsi256_pd(isZero))) << i;
+    }
+    return ~zero;
+}
+
+__attribute__((target("avx2")))
+void selectAvx2(const int64_t* condition, const int64_t* then, const int64_t* otherwise, int64_t* out) {
+    for (size_t i = 0; i < WIDTH; i += 4) {
+        __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(condition + i));
+        __m256i isZero = _mm256_cmpeq_epi64(value, _mm256_setzero_si256());
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(then + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(otherwise + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_blendv_epi8(a, b, isZero));
+    }
+}
+
+#endif
+
+uint64_t addOrSubtract(const int64_t* left, const int64_t* right, int64_t* out, bool subtract) {
+#ifdef TOY_LANES_AVX2
+    if (hasAvx2()) {
+        return addOrSubtractAvx2(left, right, out, subtract);
+    }
+#endif
+    uint64_t overflow = 0;
+#ifdef TOY_LANES_SSE2
+    for (size_t i = 0; i < WIDTH; i += 2) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(left + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(right + i));
+        __m128i result = subtract ? _mm_sub_epi64(a, b) : _mm_add_epi64(a, b);
+        __m128i wrong = subtract ? _mm_and_si128(_mm_xor_si128(a, b), _mm_xor_si128(a, result))
+                                 : _mm_and_si128(_mm_xor_si128(a, result), _mm_xor_si128(b, result));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), result);
+        overflow |= static_cast<uint64_t>(_mm_movemask_pd(_mm_castsi128_pd(wrong))) << i;
+    }
+#else
+    for (size_t i = 0; i < WIDTH; i++) {
+        int64_t result;
+        bool ok = subtract ? Value::checkedSubtract(left[i], right[i], result)
+                           : Value::checkedAdd(left[i], right[i], result);
+        out[i] = result;
+        overflow |= static_cast<uint64_t>(!ok) << i;
+    }
+#endif
+    return overflow;
+}
+
+// No SIMD instruction set below AVX-512 multiplies 64-bit lanes.
+uint64_t multiply(const int64_t* left, const int64_t* right, int64_t* out) {
+    uint64_t overflow = 0;
+    for (size_t i = 0; i < WIDTH; i++) {
+        overflow |= static_cast<uint64_t>(!Value::checkedMultiply(left[i], right[i], out[i])) << i;
+    }
+    return overflow;
+}
+
+// Only divides in `active` lanes, since the others may hold a zero.
+uint64_t divide(const int64_t* left, const int64_t* right, int64_t* out, uint64_t active) {
+    uint64_t failed = 0;
+    for (size_t i = 0; i < WIDTH; i++) {
+        if (!(active >> i & 1)) {
+            continue;
+        }
+        if (right[i] == 0 || (right[i] == -1 && left[i] == INT64_MIN)) {
+            failed |= uint64_t(1) << i;
+        } else {
+            out[i] = left[i] / right[i];
+        }
+    }
+    return failed;
+}
+
+void compare(char op, const int64_t* left, const int64_t* right, int64_t* out) {
+#ifdef TOY_LANES_AVX2
+    if (hasAvx2()) {
+        compareAvx2(op, left, right, out);
+        return;
+    }
+#endif
+    switch (op) {
+        case '=':
+            for (size_t i = 0; i < WIDTH; i++) {
+                out[i] = left[i] == right[i];
+            }
+            break;
+        case '!':
+            for (size_t i = 0; i < WIDTH; i++) {
+                out[i] = left[i] != right[i];
+            }
+            break;
+        default:
+            for (size_t i = 0; i < WIDTH; i++) {
+                out[i] = left[i] < right[i];
+            }
+            break;
+    }
+}
+
+uint64_t nonzero(const int64_t* values) {
+#ifdef TOY_LANES_AVX2
+    if (hasAvx2()) {
+        return nonzeroAvx2(values);
+    }
+#endif
+    uint64_t mask = 0;
+    for (size_t i = 0; i < WIDTH; i++) {
+        mask |= static_cast<uint64_t>(values[i] != 0) << i;
+    }
+    return mask;
+}
+
+void select(const int64_t* condition, const int64_t* then, const int64_t* otherwise, int64_t* out) {
+#ifdef TOY_LANES_AVX2
+    if (hasAvx2()) {
+        selectAvx2(condition, then, otherwise, out);
+        return;
+    }
+#endif
+    for (size_t i = 0; i < WIDTH; i++) {
+        out[i] = condition[i] != 0 ? then[i] : otherwise[i];
+    }
+}
+
+}
+
+LaneEvaluator::LaneEvaluator(const FlatFunction& function, Symbol name, ExecutionContext& context)
+    : function(function), name(name), context(context), columns(function.nodes.size()), slots(function.frameSize) {}
+
+bool LaneEvaluator::supports(const FlatFunction& function) {
+    if (function.returnExpr == FlatFunction::NONE || !function.nested.empty()) {
+        return false;
+    }
+    for (const FlatNode& node : function.nodes) {
+        switch (node.kind) {
+            case FlatNode::Kind::NUMBER:
+                if (node.count) {
+                    return false;
+                }
+                break;
+            case FlatNode::Kind::IDENTIFIER:
+                if (node.b != 0) {
+                    return false;
+                }
+                break;
+            case FlatNode::Kind::FUNCTION_DEF:
+                return false;
+            default:
+                break;
+        }
+    }
+    return true;
+}
+
+void LaneEvaluator::run(const std::vector<const int64_t*>& args, size_t rows, int64_t* results) {
+    // A profile should show every call, and lanes make none.
+    if (!supports(function) || context.getProfiler()) {
+        for (size_t row = 0; row < rows; row++) {
+            results[row] = runRow(args, row);
+        }
+        return;
+    }
+
+    // The last block is read from zero-padded copies of its arguments.
+    std::vector<Column> padded(args.size());
+    std::vector<const int64_t*> block(args.size());
+    Column out;
+
+    for (size_t begin = 0; begin < rows; begin += WIDTH) {
+        size_t count = std::min(WIDTH, rows - begin);
+        for (size_t i = 0; i < args.size(); i++) {
+            if (count == WIDTH) {
+                block[i] = args[i] + begin;
+            } else {
+                std::fill(std::copy(args[i] + begin, args[i] + rows, padded[i].lane), padded[i].lane + WIDTH, 0);
+                block[i] = padded[i].lane;
+            }
+        }
+
+        uint64_t active = count == WIDTH ? ~uint64_t(0) : (uint64_t(1) << count) - 1;
+        uint64_t rerun = runBlock(block.data(), active, out.lane);
+
+        for (size_t lane = 0; lane < count; lane++) {
+            results[begin + lane] = rerun >> lane & 1 ? runRow(args, begin + lane) : out.lane[lane];
+        }
+    }
+}
+
+uint64_t LaneEvaluator::runBlock(const int64_t* const* args, uint64_t active, int64_t* results) {
+    failed = 0;
+    std::fill(slots.begin(), slots.end(), nullptr);
+    std::copy(args, args + function.paramCount, slots.begin());
+
+    for (uint32_t stmt : function.body) {
+        evaluate(stmt, active);
+    }
+    const int64_t* result = evaluate(function.returnExpr, active);
+    std::copy(result, result + WIDTH, results);
+    return failed & active;
+}
+
+const int64_t* LaneEvaluator::evaluate(uint32_t index, uint64_t active) {
+    const FlatNode& node = function.nodes[index];
+    int64_t* out = columns[index].lane;
+
+    switch (node.kind) {
+        case FlatNode::Kind::NUMBER:
+            std::fill(out, out + WIDTH, static_cast<int64_t>(uint64_t(node.b) << 32 | node.a));
+            return out;
+
+        case FlatNode::Kind::IDENTIFIER:
+            if (!slots[node.a]) {
+                failed |= active;
+                return out;
+            }
+            return slots[node.a];
+
+        case FlatNode::Kind::BINARY_OP: {
+            const int64_t* left = evaluate(node.a, active);
+            const int64_t* right = evaluate(node.b, active);
+            switch (node.op) {
+                case '+': failed |= addOrSubtract(left, right, out, false) & active; break;
+                case '-': failed |= addOrSubtract(left, right, out, true) & active; break;
+                case '*': failed |= multiply(left, right, out) & active; break;
+                case '/': failed |= divide(left, right, out, active); break;
+                case '=':
+                case '!':
+                case '<': compare(node.op, left, right, out); break;
+                default: failed |= active; break;
+            }
+            return out;
+        }
+
+        case FlatNode::Kind::TERNARY: {
+            const int64_t* condition = evaluate(node.a, active);
+            uint64_t taken = nonzero(condition) & active;
+            if (taken == active) {
+                return evaluate(node.b, active);
+            }
+            if (taken == 0) {
+                return evaluate(node.c, active);
+            }
+            const int64_t* then = evaluate(node.b, taken);
+            const int64_t* otherwise = evaluate(node.c, active & ~taken);
+            select(condition, then, otherwise, out);
+            return out;
+        }
+
+        case FlatNode::Kind::CALL:
+            return call(node, active, out);
+
+        case FlatNode::Kind::ASSIGNMENT:
+            slots[node.a] = evaluate(node.b, active);
+            return out;
+
+        case FlatNode::Kind::RETURN:
+            return evaluate(node.a, active);
+
+        case FlatNode::Kind::FUNCTION_DEF:
+            break;
+    }
+    failed |= active;
+    return out;
+}
+
+// Lanes that already failed are left out, since their rows are run again
+// anyway. An error from the callee only fails its lane: whether the row
+// raises it, or an earlier error, is for running the row again to decide.
+const int64_t* LaneEvaluator::call(const FlatNode& node, uint64_t active, int64_t* out) {
+    std::vector<const int64_t*> args(node.count);
+    for (uint32_t i = 0; i < node.count; i++) {
+        args[i] = evaluate(function.arguments[node.b + i], active);
+    }
+
+    std::vector<Value> values(node.count);
+    uint64_t pending = active & ~failed;
+    for (size_t lane = 0; lane < WIDTH; lane++) {
+        if (!(pending >> lane & 1)) {
+            continue;
+        }
+        for (uint32_t i = 0; i < node.count; i++) {
+            values[i] = Value(args[i][lane]);
+        }
+        try {
+            Value result = context.run(static_cast<Symbol>(node.a), values);
+            if (result.isBig()) {
+                failed |= uint64_t(1) << lane;
+            } else {
+                out[lane] = result.asInt();
+            }
+        } catch (...) {
+            failed |= uint64_t(1) << lane;
+        }
+    }
+    return out;
+}
+
+int64_t LaneEvaluator::runRow(const std::vector<const int64_t*>& args, size_t row) {
+    std::vector<Value> values;
+    values.reserve(args.size());
+    for (const int64_t* column : args) {
+        values.emplace_back(column[row]);
+    }
+
+    Value result = context.run(name, values);
+    if (result.isBig()) {
+        throw RuntimeError("Result of " + symbolName(name) + " does not fit in 64 bits: " + result.toString());
+    }
+    return result.asInt();
+}
@@ -2,47 +2,302 @@
 #include "error.h"
 #include "tokenzier.h"
 #include "parser.h"
-#include <iostream>
+#include "mapped_file.h"
+#include "server.h"
+#include <chrono>
 #include <fstream>
+#include <iostream>
 #include <sstream>
 #include <vector>
 #include <string>
 
+namespace {
+
+bool parseArgument(const std::string& text, std::vector<Value>& args) {
+    Value value;
+    if (!Value::parse(text, value)) {
+        std::cerr << "Error: Invalid argument '" << text << "', expected integer" << std::endl;
+        return false;
+    }
+    args.push_back(value);
+    return true;
+}
+
+// Reads one argument tuple per line from stdin and prints one result per
+// line, in the same order.
+int runBatch(Interpreter& interpreter, const std::string& function_name) {
+    std::vector<std::vector<Value>> batch;
+    std::string line;
+    
+    while (std::getline(std::cin, line)) {
+        std::istringstream fields(line);
+        std::string field;
+        std::vector<Value> args;
+        
+        while (fields >> field) {
+            if (!parseArgument(field, args)) {
+                return 1;
+            }
+        }
+        batch.push_back(std::move(args));
+    }
+    
+    for (const BatchResult& result : interpreter.runBatch(function_name, batch)) {
+        if (result.ok()) {
+            std::cout << "Result: " << result.value.toString() << '\n';
+        } else {
+            std::cout << describeError(result.error) << '\n';
+        }
+    }
+    std::cout.flush();
+    return 0;
+}
+
+void writeStats(const Interpreter& interpreter) {
+    if (!RuntimeStats::enabled) {
+        std::cerr << "Stats are not available: configure with -DTOY_STATS=ON" << std::endl;
+        return;
+    }
+    std::cerr << "Stats:\n";
+    interpreter.getStats().write(std::cerr);
+}
+
+// Prints the profile table to stderr and writes the collapsed stacks for
+// flame graph tools to `path`.
+void writeProfile(const Interpreter& interpreter, const std::string& path) {
+    Profiler profile = interpreter.getProfile();
+    
+    std::cerr << "Profile:\n";
+    profile.writeTable(std::cerr);
+    
+    std::ofstream out(path);
+    profile.writeCollapsed(out);
+    if (!out) {
+        std::cerr << "Could not write profile to " << path << std::endl;
+    } else {
+        std::cerr << "Collapsed stacks written to " << path << std::endl;
+    }
+}
+
+// Lists, for each caller, the callees whose calls were replaced by their
+// bodies.
+void writeInlineReport(const Program& program) {
+    std::cerr << "Inlined:\n";
+    if (program.getInlinedCalls().empty()) {
+        std::cerr << "  nothing\n";
+    }
+    for (const InlinedCall& inlined : program.getInlinedCalls()) {
+        std::cerr << "  " << symbolName(inlined.callee) << " into " << symbolName(inlined.caller) << ": "
+                  << inlined.sites << (inlined.sites == 1 ? " call\n" : " calls\n");
+    }
+    std::cerr.flush();
+}
+
+}
+
 int main(int argc, char* argv[]) {
     try {
-        if (argc < 2) {
-            std::cerr << "Usage: " << argv[0] << " <filename> [function] [args...]" << std::endl;
+        Engine engine = Engine::Bytecode;
+        bool optimize = true;
+        size_t inlineLimit = Inliner::DEFAULT_LIMIT;
+        bool inlineReport = false;
+        bool memoize = false;
+        size_t memoSize = 100000;
+        bool batch = false;
+        size_t threads = 0;
+        bool serve = false;
+        std::string socketPath;
+        bool cache = false;
+        std::string cachePath;
+        bool profile = false;
+        std::string profilePath;
+        bool stats = false;
+        RunLimits limits;
+        size_t stackLimit = VirtualMachine::DEFAULT_STACK_LIMIT;
+        int argi = 1;
+        
+        for (; argi < argc && std::string(argv[argi]).rfind("--", 0) == 0; argi++) {
+            std::string option = argv[argi];
+            
+            if (option == "--engine=bytecode") {
+                engine = Engine::Bytecode;
+            } else if (option == "--engine=tree") {
+                engine = Engine::TreeWalker;
+            } else if (option == "--engine=jit") {
+                engine = Engine::Jit;
+            } else if (option == "--optimize") {
+                optimize = true;
+            } else if (option == "--no-optimize") {
+                optimize = false;
+            } else if (option.rfind("--inline-limit=", 0) == 0) {
+                inlineLimit = std::stoul(option.substr(15));
+            } else if (option == "--inline-report") {
+                inlineReport = true;
+            } else if (option == "--memoize") {
+                memoize = true;
+            } else if (option.rfind("--memo-size=", 0) == 0) {
+                memoize = true;
+                memoSize = std::stoul(option.substr(12));
+            } else if (option == "--batch") {
+                batch = true;
+            } else if (option.rfind("--threads=", 0) == 0) {
+                threads = std::stoul(option.substr(10));
+            } else if (option == "--serve") {
+                serve = true;
+            } else if (option.rfind("--serve=", 0) == 0) {
+                serve = true;
+                socketPath = option.substr(8);
+            } else if (option == "--cache") {
+                cache = true;
+            } else if (option.rfind("--cache=", 0) == 0) {
+                cache = true;
+                cachePath = option.substr(8);
+            } else if (option.rfind("--max-calls=", 0) == 0) {
+                limits.maxCalls = std::stoull(option.substr(12));
+            } else if (option.rfind("--max-depth=", 0) == 0) {
+                limits.maxDepth = std::stoul(option.substr(12));
+            } else if (option.rfind("--stack-limit=", 0) == 0) {
+                stackLimit = std::stoull(option.substr(14)) << 20;
+            } else if (option.rfind("--timeout=", 0) == 0) {
+                limits.timeout = std::chrono::milliseconds(std::stoll(option.substr(10)));
+            } else if (option == "--stats") {
+                stats = true;
+            } else if (option == "--profile") {
+                profile = true;
+            } else if (option.rfind("--profile=", 0) == 0) {
+                profile = true;
+                profilePath = option.substr(10);
+            } else {
+                std::cerr << "Unknown option: " << option << std::endl;
+                return 1;
+            }
+        }
+        
+        if (argc - argi < 1) {
+            std::cerr << "Usage: " << argv[0] << " [options] <filename> [function] [args...]\n"
+                      << "  --engine=bytecode|tree|jit\n"
+                      << "                          execution engine (default bytecode)\n"
+                      << "  --no-optimize           skip constant folding and inlining\n"
+                      << "  --inline-limit=N        inline functions of at most N nodes, 0 for none (default "
+                      << Inliner::DEFAULT_LIMIT << ")\n"
+                      << "  --inline-report         list the inlined calls; loads from source, not the cache\n"
+                      << "  --cache                 reuse the compiled program in <filename>c\n"
+                      << "  --cache=PATH            reuse the compiled program in PATH\n"
+                      << "  --memoize               cache results of pure functions\n"
+                      << "  --memo-size=N           memoize with at most N entries\n"
+                      << "  --batch                 call function once per line of arguments on stdin\n"
+                      << "  --threads=N             threads for --batch (default: all cores)\n"
+                      << "  --max-calls=N           fail a run after N calls\n"
+                      << "  --max-depth=N           fail a run that nests more than N calls\n"
+                      << "  --timeout=MS            fail a run that takes longer than MS milliseconds\n"
+                      << "  --stack-limit=MB        call stack memory of a run, the tree engine's C++ stack\n"
+                      << "                          included (default 256)\n"
+                      << "  --stats                 print interpreter counters after the run\n"
+                      << "  --profile               print time per function, write stacks to <filename>.folded\n"
+                      << "  --profile=PATH          profile, writing the collapsed stacks to PATH\n"
+                      << "  --serve                 answer \"function args...\" lines on stdin\n"
+                      << "  --serve=PATH            answer requests on a Unix domain socket" << std::endl;
             return 1;
         }
         
-        std::string filename = argv[1];
-        std::ifstream file(filename);
+        std::string filename = argv[argi];
+        MappedFile file;
         
-        if (!file.is_open()) {
+        if (!file.open(filename)) {
             std::cerr << "Could not open file: " << filename << std::endl;
             return 1;
         }
         
-        Interpreter interpreter(file);
+        std::shared_ptr<const Program> program;
+        // A program read from the cache cannot say what was inlined.
+        if (cache && !inlineReport) {
+            program = Program::loadCached(file.view(), cachePath.empty() ? filename + "c" : cachePath, optimize,
+                                          inlineLimit);
+        } else {
+            program = std::make_shared<const Program>(file.view(), optimize, inlineLimit);
+        }
+        if (inlineReport) {
+            writeInlineReport(*program);
+        }
         
-        if (argc >= 3) {
-            std::string function_name = argv[2];
-            std::vector<int> args;
+        if (serve) {
+            if (argc - argi != 1) {
+                std::cerr << "Error: --serve takes only a filename" << std::endl;
+                return 1;
+            }
+            if (profile) {
+                std::cerr << "Error: --profile cannot be used with --serve" << std::endl;
+                return 1;
+            }
             
-            for (int i = 3; i < argc; i++) {
-                try {
-                    args.push_back(std::stoi(argv[i]));
-                } catch (const std::invalid_argument&) {
-                    std::cerr << "Error: Invalid argument '" << argv[i] << "', expected integer" << std::endl;
-                    return 1;
-                } catch (const std::out_of_range&) {
-                    std::cerr << "Error: Argument '" << argv[i] << "' is out of valid integer range" << std::endl;
+            Server server(program, engine);
+            if (memoize) {
+                server.enableMemoization(memoSize);
+            }
+            server.setLimits(limits);
+            server.setStackLimit(stackLimit);
+            
+            if (socketPath.empty()) {
+                std::ios::sync_with_stdio(false);
+                server.serve(std::cin, std::cout);
+            } else {
+                server.serveSocket(socketPath);
+            }
+            return 0;
+        }
+        
+        Interpreter interpreter(program, engine);
+        if (memoize) {
+            interpreter.enableMemoization(memoSize);
+        }
+        interpreter.setThreadCount(threads);
+        interpreter.setLimits(limits);
+        interpreter.setStackLimit(stackLimit);
+        if (profile) {
+            interpreter.enableProfiling();
+            if (profilePath.empty()) {
+                profilePath = filename + ".folded";
+            }
+        }
+        
+        if (batch) {
+            if (argc - argi != 2) {
+                std::cerr << "Error: --batch takes a function name and reads arguments from stdin" << std::endl;
+                return 1;
+            }
+            int status = runBatch(interpreter, argv[argi + 1]);
+            if (stats) {
+                writeStats(interpreter);
+            }
+            if (profile) {
+                writeProfile(interpreter, profilePath);
+            }
+            return status;
+        }
+        
+        if (argc - argi >= 2) {
+            std::string function_name = argv[argi + 1];
+            std::vector<Value> args;
+            
+            for (int i = argi + 2; i < argc; i++) {
+                if (!parseArgument(argv[i], args)) {
                     return 1;
                 }
             }
             
-            int result = interpreter.run(function_name, args);
-            std::cout << "Result: " << result << std::endl;
+            Value result = interpreter.run(function_name, args);
+            std::cout << "Result: " << result.toString() << std::endl;
+            
+            if (const MemoCache* memo = interpreter.getMemoCache()) {
+                std::cerr << "Memo: " << memo->hits() << " hits, " << memo->misses() << " misses, "
+                          << memo->size() << "/" << memo->getCapacity() << " entries" << std::endl;
+            }
+            if (stats) {
+                writeStats(interpreter);
+            }
+            if (profile) {
+                writeProfile(interpreter, profilePath);
+            }
         } else {
             std::cout << "No function specified to run." << std::endl;
         }
@@ -56,6 +311,9 @@ int main(int argc, char* argv[]) {
     } catch (const RuntimeError& e) {
         std::cerr << "Runtime Error: " << e.what() << std::endl;
         return 1;
+    } catch (const LimitError& e) {
+        std::cerr << "Limit Error: " << e.what() << std::endl;
+        return 1;
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
         return 1;
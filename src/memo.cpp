@@ -0,0 +1,60 @@
+#include "memo.h"
+#include <functional>
+
+size_t MemoCache::KeyHash::operator()(const Key& key) const {
+    size_t hash = std::hash<const void*>()(key.function);
+    for (const Value& arg : key.args) {
+        size_t value = arg.hash();
+        hash ^= value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+    }
+    return hash;
+}
+
+MemoCache::MemoCache(size_t capacity) : capacity(capacity) {}
+
+bool MemoCache::lookup(const void* function, const Value* args, size_t argc, Value& result) {
+    // The probe key is reused so that lookups do not allocate.
+    probe.function = function;
+    probe.args.assign(args, args + argc);
+
+    auto it = index.find(probe);
+    if (it == index.end()) {
+        missCount++;
+        return false;
+    }
+
+    hitCount++;
+    entries.splice(entries.begin(), entries, it->second);
+    result = it->second->second;
+    return true;
+}
+
+void MemoCache::store(const void* function, const Value* args, size_t argc, Value result) {
+    if (capacity == 0) {
+        return;
+    }
+
+    Key key{function, std::vector<Value>(args, args + argc)};
+
+    auto it = index.find(key);
+    if (it != index.end()) {
+        it->second->second = result;
+        entries.splice(entries.begin(), entries, it->second);
+        return;
+    }
+
+    if (entries.size() >= capacity) {
+        index.erase(entries.back().first);
+        entries.pop_back();
+    }
+
+    entries.emplace_front(key, result);
+    index.emplace(std::move(key), entries.begin());
+}
+
+void MemoCache::clear() {
+    entries.clear();
+    index.clear();
+    hitCount = 0;
+    missCount = 0;
+}
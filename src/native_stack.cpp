@@ -0,0 +1,84 @@
+#include "native_stack.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__) || defined(__APPLE__)
+#include <pthread.h>
+#endif
+
+namespace {
+
+#ifdef _WIN32
+DWORD WINAPI runBody(LPVOID body) {
+    (*static_cast<const std::function<void()>*>(body))();
+    return 0;
+}
+#elif defined(__linux__) || defined(__APPLE__)
+void* runBody(void* body) {
+    (*static_cast<const std::function<void()>*>(body))();
+    return nullptr;
+}
+#endif
+
+uintptr_t lookUpStackLow() {
+#ifdef _WIN32
+    ULONG_PTR low = 0;
+    ULONG_PTR high = 0;
+    GetCurrentThreadStackLimits(&low, &high);
+    return static_cast<uintptr_t>(low);
+#elif defined(__APPLE__)
+    pthread_t self = pthread_self();
+    return reinterpret_cast<uintptr_t>(pthread_get_stackaddr_np(self)) - pthread_get_stacksize_np(self);
+#elif defined(__linux__)
+    pthread_attr_t attr;
+    if (pthread_getattr_np(pthread_self(), &attr) != 0) {
+        return 0;
+    }
+    void* low = nullptr;
+    size_t size = 0;
+    int failed = pthread_attr_getstack(&attr, &low, &size);
+    pthread_attr_destroy(&attr);
+    return failed ? 0 : reinterpret_cast<uintptr_t>(low);
+#else
+    return 0;
+#endif
+}
+
+}
+
+uintptr_t nativeStackLow() {
+    thread_local uintptr_t low = lookUpStackLow();
+    return low;
+}
+
+bool runOnNewStack(size_t bytes, const std::function<void()>& body) {
+#ifdef _WIN32
+    HANDLE thread = CreateThread(nullptr, bytes, runBody, const_cast<std::function<void()>*>(&body),
+                                 STACK_SIZE_PARAM_IS_A_RESERVATION, nullptr);
+    if (!thread) {
+        return false;
+    }
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+    return true;
+#elif defined(__linux__) || defined(__APPLE__)
+    pthread_attr_t attr;
+    if (pthread_attr_init(&attr) != 0) {
+        return false;
+    }
+    pthread_t thread;
+    bool started = pthread_attr_setstacksize(&attr, bytes) == 0 &&
+                   pthread_create(&thread, &attr, runBody, const_cast<std::function<void()>*>(&body)) == 0;
+    pthread_attr_destroy(&attr);
+    if (started) {
+        pthread_join(thread, nullptr);
+    }
+    return started;
+#else
+    (void)bytes;
+    (void)body;
+    return false;
+#endif
+}
@@ -0,0 +1,187 @@
+#include "optimizer.h"
+
+namespace {
+
+bool constantOf(ExprAST* expr, Value& value) {
+    if (auto number = dynamic_cast<NumberAST*>(expr)) {
+        value = number->getValue();
+        return true;
+    }
+    return false;
+}
+
+// Mirrors the engines' arithmetic. Operations that fail at runtime are left
+// unfolded so the error is still raised when the expression is evaluated.
+bool fold(char op, const Value& left, const Value& right, Value& value) {
+    switch (op) {
+        case '+': value = Value::add(left, right); return true;
+        case '-': value = Value::subtract(left, right); return true;
+        case '*': value = Value::multiply(left, right); return true;
+        case '/':
+            if (right.isZero()) {
+                return false;
+            }
+            value = Value::divide(left, right);
+            return true;
+        case '=': value = Value(Value::equal(left, right) ? 1 : 0); return true;
+        case '!': value = Value(Value::equal(left, right) ? 0 : 1); return true;
+        case '<': value = Value(Value::less(left, right) ? 1 : 0); return true;
+        default: return false;
+    }
+}
+
+// True if evaluating the expression can neither raise an error nor run a
+// call, so dropping it (as in x * 0) is unobservable. Locals are always bound
+// when read; outer variables may not be yet.
+bool cannotFail(ExprAST* expr) {
+    if (dynamic_cast<NumberAST*>(expr)) {
+        return true;
+    }
+    if (auto identifier = dynamic_cast<IdentifierAST*>(expr)) {
+        return identifier->getDepth() == 0;
+    }
+    if (auto binary = dynamic_cast<BinaryOpAST*>(expr)) {
+        if (binary->getOp() == '/') {
+            Value divisor;
+            if (!constantOf(binary->getRight(), divisor) || divisor.isZero()) {
+                return false;
+            }
+        }
+        return cannotFail(binary->getLeft()) && cannotFail(binary->getRight());
+    }
+    if (auto ternary = dynamic_cast<TernaryExprAST*>(expr)) {
+        return cannotFail(ternary->getCondition()) &&
+               cannotFail(ternary->getThenExpr()) &&
+               cannotFail(ternary->getElseExpr());
+    }
+    return false;
+}
+
+}
+
+Optimizer::Optimizer(Arena& arena) : arena(arena) {}
+
+void Optimizer::optimize(ProgramAST& program) {
+    Optimizer optimizer(program.getArena());
+    for (FunctionDefAST* func : program.getFunctions()) {
+        func->accept(optimizer);
+    }
+}
+
+ExprAST* Optimizer::optimize(ExprAST* expr) {
+    replacement = expr;
+    expr->accept(*this);
+    return replacement;
+}
+
+void Optimizer::visit(ExprAST& expr) {
+    (void)expr;
+}
+
+void Optimizer::visit(NumberAST& number) {
+    (void)number;
+}
+
+void Optimizer::visit(IdentifierAST& identifier) {
+    (void)identifier;
+}
+
+void Optimizer::visit(BinaryOpAST& binary) {
+    ExprAST* left = optimize(binary.getLeft());
+    ExprAST* right = optimize(binary.getRight());
+    binary.setOperands(left, right);
+    replacement = simplify(binary);
+}
+
+ExprAST* Optimizer::simplify(BinaryOpAST& binary) {
+    ExprAST* left = binary.getLeft();
+    ExprAST* right = binary.getRight();
+
+    Value l, r;
+    bool leftConstant = constantOf(left, l);
+    bool rightConstant = constantOf(right, r);
+
+    if (leftConstant && rightConstant) {
+        Value value;
+        if (fold(binary.getOp(), l, r, value)) {
+            return makeNumber(value);
+        }
+        return &binary;
+    }
+
+    const Value zero(0);
+    const Value one(1);
+
+    switch (binary.getOp()) {
+        case '+':
+            if (rightConstant && r == zero) return left;
+            if (leftConstant && l == zero) return right;
+            break;
+        case '-':
+            if (rightConstant && r == zero) return left;
+            break;
+        case '*':
+            if ((rightConstant && r == zero && cannotFail(left)) ||
+                (leftConstant && l == zero && cannotFail(right))) {
+                return arena.make<NumberAST>(0);
+            }
+            if (rightConstant && r == one) return left;
+            if (leftConstant && l == one) return right;
+            break;
+        case '/':
+            if (rightConstant && r == one) return left;
+            break;
+    }
+
+    return &binary;
+}
+
+NumberAST* Optimizer::makeNumber(const Value& value) {
+    if (value.isBig()) {
+        return arena.make<NumberAST>(arena.copyString(value.toString()));
+    }
+    return arena.make<NumberAST>(value.asInt());
+}
+
+void Optimizer::visit(TernaryExprAST& ternary) {
+    ExprAST* condition = optimize(ternary.getCondition());
+
+    Value value;
+    if (constantOf(condition, value)) {
+        replacement = optimize(!value.isZero() ? ternary.getThenExpr() : ternary.getElseExpr());
+        return;
+    }
+
+    ExprAST* then_expr = optimize(ternary.getThenExpr());
+    ExprAST* else_expr = optimize(ternary.getElseExpr());
+    ternary.setArms(condition, then_expr, else_expr);
+    replacement = &ternary;
+}
+
+void Optimizer::visit(FunctionCallAST& call) {
+    for (ExprAST*& arg : call.getArgs()) {
+        arg = optimize(arg);
+    }
+    replacement = &call;
+}
+
+void Optimizer::visit(StatementAST& stmt) {
+    (void)stmt;
+}
+
+void Optimizer::visit(AssignmentAST& assignment) {
+    assignment.setValue(optimize(assignment.getValue()));
+}
+
+void Optimizer::visit(ReturnStmtAST& returnStmt) {
+    returnStmt.setReturnExpr(optimize(returnStmt.getReturnExpr()));
+}
+
+void Optimizer::visit(FunctionDefAST& functionDef) {
+    for (StatementAST* stmt : functionDef.getBody()) {
+        stmt->accept(*this);
+    }
+    if (functionDef.getReturnExpr()) {
+        functionDef.setReturnExpr(optimize(functionDef.getReturnExpr()));
+    }
+}
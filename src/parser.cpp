@@ -3,10 +3,19 @@
 #include "error.h"
 #include <sstream>
 
+Value NumberAST::getValue() const {
+    Value result(value);
+    if (isBig()) {
+        Value::parse(digits, result);
+    }
+    return result;
+}
+
 Parser::Parser(Tokenizer* tokenizer) : tokenizer(tokenizer) {}
 
-std::vector<std::unique_ptr<FunctionDefAST>> Parser::parseProgram() {
-    std::vector<std::unique_ptr<FunctionDefAST>> functions;
+ProgramAST Parser::parseProgram() {
+    ProgramAST program;
+    arena = &program.getArena();
     
     while (!tokenizer->IsEnd()) {
         while (!tokenizer->IsEnd() && 
@@ -23,7 +32,7 @@ std::vector<std::unique_ptr<FunctionDefAST>> Parser::parseProgram() {
         
         if (std::holds_alternative<UtilityTokens>(token) && 
             std::get<UtilityTokens>(token) == UtilityTokens::DEF) {
-            functions.push_back(parseFunctionDef());
+            program.addFunction(parseFunctionDef());
         } else {
             std::stringstream ss;
             ss << "Expected function definition or newline";
@@ -31,10 +40,11 @@ std::vector<std::unique_ptr<FunctionDefAST>> Parser::parseProgram() {
         }
     }
     
-    return functions;
+    arena = nullptr;
+    return program;
 }
 
-std::unique_ptr<FunctionDefAST> Parser::parseFunctionDef() {
+FunctionDefAST* Parser::parseFunctionDef() {
     if (!std::holds_alternative<UtilityTokens>(tokenizer->GetToken()) || 
         std::get<UtilityTokens>(tokenizer->GetToken()) != UtilityTokens::DEF) {
         throw SyntaxError("Expected 'def' keyword");
@@ -44,7 +54,7 @@ std::unique_ptr<FunctionDefAST> Parser::parseFunctionDef() {
     if (!std::holds_alternative<SymbolToken>(tokenizer->GetToken())) {
         throw SyntaxError("Expected function name after 'def'");
     }
-    std::string name = std::get<SymbolToken>(tokenizer->GetToken()).name;
+    Symbol name = std::get<SymbolToken>(tokenizer->GetToken()).symbol;
     tokenizer->Next();
     
     if (!std::holds_alternative<EmbracingToken>(tokenizer->GetToken()) || 
@@ -53,7 +63,7 @@ std::unique_ptr<FunctionDefAST> Parser::parseFunctionDef() {
     }
     tokenizer->Next();
     
-    std::vector<std::string> params;
+    size_t paramsStart = nameScratch.size();
     
     if (!std::holds_alternative<EmbracingToken>(tokenizer->GetToken()) || 
         std::get<EmbracingToken>(tokenizer->GetToken()) != EmbracingToken::RPAREN) {
@@ -61,7 +71,7 @@ std::unique_ptr<FunctionDefAST> Parser::parseFunctionDef() {
         if (!std::holds_alternative<SymbolToken>(tokenizer->GetToken())) {
             throw SyntaxError("Expected parameter name");
         }
-        params.push_back(std::get<SymbolToken>(tokenizer->GetToken()).name);
+        nameScratch.push_back(std::get<SymbolToken>(tokenizer->GetToken()).symbol);
         tokenizer->Next();
         
         while (std::holds_alternative<EmbracingToken>(tokenizer->GetToken()) && 
@@ -71,7 +81,7 @@ std::unique_ptr<FunctionDefAST> Parser::parseFunctionDef() {
             if (!std::holds_alternative<SymbolToken>(tokenizer->GetToken())) {
                 throw SyntaxError("Expected parameter name after ','");
             }
-            params.push_back(std::get<SymbolToken>(tokenizer->GetToken()).name);
+            nameScratch.push_back(std::get<SymbolToken>(tokenizer->GetToken()).symbol);
             tokenizer->Next();
         }
     }
@@ -88,8 +98,10 @@ std::unique_ptr<FunctionDefAST> Parser::parseFunctionDef() {
     }
     tokenizer->Next();
     
-    std::vector<std::unique_ptr<StatementAST>> body;
-    std::unique_ptr<ExprAST> return_expr = nullptr;
+    ArenaSpan<Symbol> params = takeScratch(nameScratch, paramsStart);
+    
+    size_t bodyStart = stmtScratch.size();
+    ExprAST* return_expr = nullptr;
     
     bool foundReturn = false;
     
@@ -106,8 +118,7 @@ std::unique_ptr<FunctionDefAST> Parser::parseFunctionDef() {
         
         if (std::holds_alternative<UtilityTokens>(tokenizer->GetToken()) && 
             std::get<UtilityTokens>(tokenizer->GetToken()) == UtilityTokens::DEF) {
-            auto nested_func = parseFunctionDef();
-            body.push_back(std::move(nested_func));
+            stmtScratch.push_back(parseFunctionDef());
             continue;
         }
         
@@ -128,7 +139,7 @@ std::unique_ptr<FunctionDefAST> Parser::parseFunctionDef() {
             break;
         }
         
-        body.push_back(parseStatement());
+        stmtScratch.push_back(parseStatement());
         
         if (!std::holds_alternative<UtilityTokens>(tokenizer->GetToken()) || 
             std::get<UtilityTokens>(tokenizer->GetToken()) != UtilityTokens::NEWLINE) {
@@ -141,19 +152,20 @@ std::unique_ptr<FunctionDefAST> Parser::parseFunctionDef() {
         throw SyntaxError("Function must end with a return statement");
     }
     
-    return std::make_unique<FunctionDefAST>(name, std::move(params), std::move(body), std::move(return_expr));
+    ArenaSpan<StatementAST*> body = takeScratch(stmtScratch, bodyStart);
+    return arena->make<FunctionDefAST>(name, params, body, return_expr);
 }
 
-std::unique_ptr<StatementAST> Parser::parseStatement() {
+StatementAST* Parser::parseStatement() {
     if (std::holds_alternative<UtilityTokens>(tokenizer->GetToken()) && 
         std::get<UtilityTokens>(tokenizer->GetToken()) == UtilityTokens::RETURN) {
         tokenizer->Next();
         auto expr = parseExpression();
-        return std::make_unique<ReturnStmtAST>(std::move(expr));
+        return arena->make<ReturnStmtAST>(expr);
     }
     
     if (std::holds_alternative<SymbolToken>(tokenizer->GetToken())) {
-        std::string name = std::get<SymbolToken>(tokenizer->GetToken()).name;
+        Symbol name = std::get<SymbolToken>(tokenizer->GetToken()).symbol;
         tokenizer->Next();
         
         if (!std::holds_alternative<OperatorToken>(tokenizer->GetToken()) || 
@@ -163,17 +175,17 @@ std::unique_ptr<StatementAST> Parser::parseStatement() {
         tokenizer->Next();
         
         auto expr = parseExpression();
-        return std::make_unique<AssignmentAST>(name, std::move(expr));
+        return arena->make<AssignmentAST>(name, expr);
     }
     
     throw SyntaxError("Expected statement");
 }
 
-std::unique_ptr<ExprAST> Parser::parseExpression() {
+ExprAST* Parser::parseExpression() {
     return parseTernaryExpr();
 }
 
-std::unique_ptr<ExprAST> Parser::parseTernaryExpr() {
+ExprAST* Parser::parseTernaryExpr() {
     if (std::holds_alternative<EmbracingToken>(tokenizer->GetToken()) && 
         std::get<EmbracingToken>(tokenizer->GetToken()) == EmbracingToken::IF) {
         tokenizer->Next();
@@ -196,14 +208,13 @@ std::unique_ptr<ExprAST> Parser::parseTernaryExpr() {
         
         auto else_expr = parseLogicalExpr();
         
-        return std::make_unique<TernaryExprAST>(
-            std::move(condition), std::move(then_expr), std::move(else_expr));
+        return arena->make<TernaryExprAST>(condition, then_expr, else_expr);
     }
     
     return parseLogicalExpr();
 }
 
-std::unique_ptr<ExprAST> Parser::parseLogicalExpr() {
+ExprAST* Parser::parseLogicalExpr() {
     auto expr = parseAddExpr();
     
     while (std::holds_alternative<OperatorToken>(tokenizer->GetToken()) && 
@@ -222,13 +233,13 @@ std::unique_ptr<ExprAST> Parser::parseLogicalExpr() {
         
         tokenizer->Next();
         auto right = parseAddExpr();
-        expr = std::make_unique<BinaryOpAST>(op, std::move(expr), std::move(right));
+        expr = arena->make<BinaryOpAST>(op, expr, right);
     }
     
     return expr;
 }
 
-std::unique_ptr<ExprAST> Parser::parseAddExpr() {
+ExprAST* Parser::parseAddExpr() {
     auto expr = parseMulExpr();
     
     while (std::holds_alternative<OperatorToken>(tokenizer->GetToken()) && 
@@ -238,13 +249,13 @@ std::unique_ptr<ExprAST> Parser::parseAddExpr() {
         char op = (std::get<OperatorToken>(tokenizer->GetToken()) == OperatorToken::PLUS) ? '+' : '-';
         tokenizer->Next();
         auto right = parseMulExpr();
-        expr = std::make_unique<BinaryOpAST>(op, std::move(expr), std::move(right));
+        expr = arena->make<BinaryOpAST>(op, expr, right);
     }
     
     return expr;
 }
 
-std::unique_ptr<ExprAST> Parser::parseMulExpr() {
+ExprAST* Parser::parseMulExpr() {
     auto expr = parsePrimary();
     
     while (std::holds_alternative<OperatorToken>(tokenizer->GetToken()) && 
@@ -254,38 +265,41 @@ std::unique_ptr<ExprAST> Parser::parseMulExpr() {
         char op = (std::get<OperatorToken>(tokenizer->GetToken()) == OperatorToken::MULTIPLY) ? '*' : '/';
         tokenizer->Next();
         auto right = parsePrimary();
-        expr = std::make_unique<BinaryOpAST>(op, std::move(expr), std::move(right));
+        expr = arena->make<BinaryOpAST>(op, expr, right);
     }
     
     return expr;
 }
 
-std::unique_ptr<ExprAST> Parser::parsePrimary() {
+ExprAST* Parser::parsePrimary() {
     if (std::holds_alternative<ConstantToken>(tokenizer->GetToken())) {
-        int value = std::get<ConstantToken>(tokenizer->GetToken()).value;
+        ConstantToken constant = std::get<ConstantToken>(tokenizer->GetToken());
         tokenizer->Next();
-        return std::make_unique<NumberAST>(value);
+        if (!constant.digits.empty()) {
+            return arena->make<NumberAST>(arena->copyString(constant.digits));
+        }
+        return arena->make<NumberAST>(constant.value);
     }
     
     if (std::holds_alternative<SymbolToken>(tokenizer->GetToken())) {
-        std::string name = std::get<SymbolToken>(tokenizer->GetToken()).name;
+        Symbol name = std::get<SymbolToken>(tokenizer->GetToken()).symbol;
         tokenizer->Next();
         
         if (std::holds_alternative<EmbracingToken>(tokenizer->GetToken()) && 
             std::get<EmbracingToken>(tokenizer->GetToken()) == EmbracingToken::LPAREN) {
             tokenizer->Next();
             
-            std::vector<std::unique_ptr<ExprAST>> args;
+            size_t argsStart = exprScratch.size();
             
             if (!std::holds_alternative<EmbracingToken>(tokenizer->GetToken()) || 
                 std::get<EmbracingToken>(tokenizer->GetToken()) != EmbracingToken::RPAREN) {
                 
-                args.push_back(parseExpression());
+                exprScratch.push_back(parseExpression());
                 
                 while (std::holds_alternative<EmbracingToken>(tokenizer->GetToken()) && 
                        std::get<EmbracingToken>(tokenizer->GetToken()) == EmbracingToken::COMMA) {
                     tokenizer->Next();
-                    args.push_back(parseExpression());
+                    exprScratch.push_back(parseExpression());
                 }
             }
             
@@ -295,10 +309,10 @@ std::unique_ptr<ExprAST> Parser::parsePrimary() {
             }
             tokenizer->Next();
             
-            return std::make_unique<FunctionCallAST>(name, std::move(args));
+            return arena->make<FunctionCallAST>(name, takeScratch(exprScratch, argsStart));
         }
         
-        return std::make_unique<IdentifierAST>(name);
+        return arena->make<IdentifierAST>(name);
     }
     
     if (std::holds_alternative<EmbracingToken>(tokenizer->GetToken()) && 
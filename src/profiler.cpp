@@ -0,0 +1,181 @@
+#include "profiler.h"
+#include <algorithm>
+#include <iomanip>
+
+Profiler::Profiler() {
+    nodes.push_back(Node{nullptr, 0, 0, {}, {}});
+}
+
+size_t Profiler::child(size_t parent, const void* function) {
+    for (size_t index : nodes[parent].children) {
+        if (nodes[index].function == function) {
+            return index;
+        }
+    }
+
+    size_t index = nodes.size();
+    nodes.push_back(Node{function, parent, 0, {}, {}});
+    nodes[parent].children.push_back(index);
+    return index;
+}
+
+void Profiler::enter(const void* function) {
+    size_t parent = active.empty() ? 0 : active.back().node;
+    size_t node = child(parent, function);
+    nodes[node].calls++;
+    active.push_back(Active{node, Clock::now()});
+}
+
+void Profiler::exit() {
+    Active call = active.back();
+    active.pop_back();
+    nodes[call.node].total += Clock::now() - call.start;
+}
+
+void Profiler::replace(const void* function) {
+    Active& call = active.back();
+    auto now = Clock::now();
+    nodes[call.node].total += now - call.start;
+
+    size_t node = child(nodes[call.node].parent, function);
+    nodes[node].calls++;
+    call = Active{node, now};
+}
+
+void Profiler::setName(const void* function, std::string name) {
+    names[function] = std::move(name);
+}
+
+void Profiler::merge(const Profiler& other) {
+    for (const auto& [function, name] : other.names) {
+        names.emplace(function, name);
+    }
+    mergeNode(other, 0, 0);
+}
+
+// With an explicit stack of (from, into) pairs, since the tree is as deep
+// as the recursion of the script.
+void Profiler::mergeNode(const Profiler& other, size_t from, size_t into) {
+    std::vector<std::pair<size_t, size_t>> pending{{from, into}};
+    while (!pending.empty()) {
+        auto [source, target] = pending.back();
+        pending.pop_back();
+        nodes[target].calls += other.nodes[source].calls;
+        nodes[target].total += other.nodes[source].total;
+        for (size_t index : other.nodes[source].children) {
+            pending.emplace_back(index, child(target, other.nodes[index].function));
+        }
+    }
+}
+
+Profiler::Clock::duration Profiler::exclusive(size_t node) const {
+    Clock::duration time = nodes[node].total;
+    for (size_t index : nodes[node].children) {
+        time -= nodes[index].total;
+    }
+    return std::max(time, Clock::duration::zero());
+}
+
+const std::string& Profiler::nameOf(const void* function) const {
+    static const std::string unknown = "?";
+    auto it = names.find(function);
+    return it == names.end() ? unknown : it->second;
+}
+
+void Profiler::writeTable(std::ostream& out) const {
+    struct Row {
+        const void* function;
+        uint64_t calls = 0;
+        Clock::duration inclusive{};
+        Clock::duration exclusive{};
+    };
+
+    std::unordered_map<const void*, Row> rows;
+    std::unordered_map<const void*, size_t> onPath;
+
+    // Depth-first with an explicit stack, since recursive scripts make the
+    // tree as deep as their recursion.
+    std::vector<std::pair<size_t, size_t>> path{{0, 0}};
+    while (!path.empty()) {
+        auto& [node, next] = path.back();
+        if (next < nodes[node].children.size()) {
+            size_t index = nodes[node].children[next++];
+            const Node& call = nodes[index];
+
+            Row& row = rows[call.function];
+            row.function = call.function;
+            row.calls += call.calls;
+            row.exclusive += exclusive(index);
+            if (onPath[call.function]++ == 0) {
+                row.inclusive += call.total;
+            }
+            path.emplace_back(index, 0);
+        } else {
+            if (node != 0) {
+                onPath[nodes[node].function]--;
+            }
+            path.pop_back();
+        }
+    }
+
+    std::vector<Row> sorted;
+    Clock::duration total{};
+    for (const auto& [function, row] : rows) {
+        sorted.push_back(row);
+        total += row.exclusive;
+    }
+    std::sort(sorted.begin(), sorted.end(), [this](const Row& a, const Row& b) {
+        if (a.exclusive != b.exclusive) {
+            return a.exclusive > b.exclusive;
+        }
+        return nameOf(a.function) < nameOf(b.function);
+    });
+
+    auto milliseconds = [](Clock::duration time) {
+        return std::chrono::duration<double, std::milli>(time).count();
+    };
+
+    std::ios::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(3)
+        << std::setw(12) << "calls" << std::setw(14) << "total ms" << std::setw(14) << "self ms"
+        << std::setw(9) << "self %" << "  function\n";
+    for (const Row& row : sorted) {
+        double share = total.count() > 0 ? 100.0 * static_cast<double>(row.exclusive.count()) /
+                                                static_cast<double>(total.count())
+                                          : 0.0;
+        out << std::setw(12) << row.calls << std::setw(14) << milliseconds(row.inclusive)
+            << std::setw(14) << milliseconds(row.exclusive) << std::setw(8) << std::setprecision(1) << share
+            << std::setprecision(3) << "%  " << nameOf(row.function) << '\n';
+    }
+    out.flags(flags);
+}
+
+void Profiler::writeCollapsed(std::ostream& out) const {
+    std::vector<std::pair<size_t, size_t>> path{{0, 0}};
+    std::string stack;
+    std::vector<size_t> lengths;
+
+    while (!path.empty()) {
+        auto& [node, next] = path.back();
+        if (next < nodes[node].children.size()) {
+            size_t index = nodes[node].children[next++];
+            lengths.push_back(stack.size());
+            if (!stack.empty()) {
+                stack += ';';
+            }
+            stack += nameOf(nodes[index].function);
+
+            auto micros = std::chrono::duration_cast<std::chrono::microseconds>(exclusive(index)).count();
+            if (micros > 0) {
+                out << stack << ' ' << micros << '\n';
+            }
+            path.emplace_back(index, 0);
+        } else {
+            if (node != 0) {
+                stack.resize(lengths.back());
+                lengths.pop_back();
+            }
+            path.pop_back();
+        }
+    }
+}
@@ -0,0 +1,108 @@
+#include "program.h"
+#include "interpreter.h"
+#include "tokenzier.h"
+#include "compiler.h"
+#include "resolver.h"
+#include "optimizer.h"
+#include "purity.h"
+#include "program_cache.h"
+#include "jit.h"
+
+Program::Program()
+    : globalEnv(std::make_unique<Environment>()),
+      globalFrame(std::make_unique<Frame>(nullptr, nullptr, nullptr, 0)) {}
+
+Program::Program(std::istream& input, bool optimize, size_t inlineLimit)
+    : globalEnv(std::make_unique<Environment>()),
+      globalFrame(std::make_unique<Frame>(nullptr, nullptr, nullptr, 0)) {
+    Tokenizer tokenizer(&input);
+    load(tokenizer, optimize, inlineLimit);
+}
+
+Program::Program(std::string_view source, bool optimize, size_t inlineLimit)
+    : globalEnv(std::make_unique<Environment>()),
+      globalFrame(std::make_unique<Frame>(nullptr, nullptr, nullptr, 0)) {
+    Tokenizer tokenizer(source);
+    load(tokenizer, optimize, inlineLimit);
+}
+
+Program::~Program() = default;
+
+std::shared_ptr<const Program> Program::loadCached(std::string_view source, const std::string& cachePath,
+                                                   bool optimize, size_t inlineLimit) {
+    std::shared_ptr<Program> program(new Program());
+    if (ProgramCache::read(cachePath, source, optimize, inlineLimit, *program)) {
+        return program;
+    }
+
+    program = std::make_shared<Program>(source, optimize, inlineLimit);
+    ProgramCache::write(cachePath, source, optimize, inlineLimit, *program);
+    return program;
+}
+
+void Program::load(Tokenizer& tokenizer, bool optimize, size_t inlineLimit) {
+    Parser parser(&tokenizer);
+    ast = parser.parseProgram();
+
+    Resolver resolver;
+    resolver.resolve(ast);
+
+    if (optimize) {
+        inlined = Inliner::inlineCalls(ast, inlineLimit);
+        Optimizer::optimize(ast);
+    }
+
+    PurityAnalysis::analyze(ast);
+
+    for (FunctionDefAST* func : ast.getFunctions()) {
+        compiled.push_back(Compiler::compile(*func));
+    }
+
+    defineGlobals();
+}
+
+void Program::defineGlobals() {
+    // Symbols mostly grow in definition order, which makes the end a good
+    // hint for a large script.
+    globalFrame->functions = std::make_unique<Frame::Functions>();
+    auto& functions = *globalFrame->functions;
+    names.reserve(compiled.size());
+    for (const auto& function : compiled) {
+        functions.insert_or_assign(functions.end(), function->name, function.get());
+        names[symbolName(function->name)] = function->name;
+    }
+    if (!cachedAST) {
+        defineTreeGlobals();
+    }
+}
+
+void Program::defineTreeGlobals() const {
+    flat = FlatProgram(ast.getFunctions());
+    for (const FlatFunction& func : flat.getFunctions()) {
+        globalEnv->defineFunction(func);
+    }
+}
+
+void Program::requireAST() const {
+    if (!cachedAST) {
+        return;
+    }
+    std::call_once(astDecoded, [this] {
+        ProgramCache::readAST(*cachedAST, ast);
+        defineTreeGlobals();
+    });
+}
+
+const JitModule& Program::getJit() const {
+    std::call_once(jitBuilt, [this] { jit = std::make_unique<JitModule>(*this); });
+    return *jit;
+}
+
+bool Program::lookup(std::string_view name, Symbol& symbol) const {
+    auto it = names.find(std::string(name));
+    if (it == names.end()) {
+        return false;
+    }
+    symbol = it->second;
+    return true;
+}
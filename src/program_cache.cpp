@@ -0,0 +1,631 @@
+#include "program_cache.h"
+#include "program.h"
+#include "error.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+
+namespace {
+
+constexpr char MAGIC[4] = {'T', 'O', 'Y', 'C'};
+constexpr uint32_t VERSION = 3;
+constexpr uint32_t ENDIAN_MARK = 0x01020304;
+constexpr uint32_t FLAG_OPTIMIZED = 1;
+
+// The file is written in the host's byte order; the byte order marker and
+// the version reject files from a different build. The payload, which the
+// bytecode engine needs, is followed by the AST section, which is only
+// decoded if the tree-walker runs.
+struct Header {
+    char magic[4];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t flags;
+    uint64_t inlineLimit;  // 0 unless optimized
+    uint64_t sourceSize;
+    uint64_t sourceHash;
+    uint64_t payloadSize;
+    uint64_t payloadHash;
+    uint64_t astSize;
+    uint64_t astHash;
+};
+
+enum class StmtTag : uint8_t { Assignment = 1, FunctionDef, Return };
+enum class ExprTag : uint8_t { Number = 1, Identifier, Binary, Ternary, Call };
+
+// Hashes 32 bytes at a time in four independent lanes, which keeps
+// checking a large file well under the cost of reading it; used both for
+// the source and the cache sections.
+uint64_t hashBytes(const char* data, size_t size) {
+    const uint64_t prime = 0x100000001b3ULL;
+    uint64_t lanes[4] = {0xcbf29ce484222325ULL ^ size, 0x9e3779b97f4a7c15ULL, 0xc2b2ae3d27d4eb4fULL,
+                         0x165667b19e3779f9ULL};
+
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        for (int lane = 0; lane < 4; lane++) {
+            uint64_t word;
+            std::memcpy(&word, data + i + 8 * lane, 8);
+            lanes[lane] = (lanes[lane] ^ word) * prime;
+            lanes[lane] ^= lanes[lane] >> 29;
+        }
+    }
+
+    uint64_t hash = lanes[0];
+    for (int lane = 1; lane < 4; lane++) {
+        hash = (hash ^ lanes[lane]) * prime;
+        hash ^= hash >> 29;
+    }
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * prime;
+        hash ^= hash >> 29;
+    }
+    for (; i < size; i++) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * prime;
+    }
+
+    hash ^= hash >> 32;
+    hash *= 0xd6e8feb86659fd93ULL;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+struct CorruptCache {};
+
+template <typename T>
+void append(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+
+class CacheWriter : public Visitor {
+    std::string& out;
+    std::unordered_map<Symbol, uint32_t> stringIndex;
+    std::vector<Symbol> strings;
+
+public:
+    explicit CacheWriter(std::string& out) : out(out) {}
+
+    const std::vector<Symbol>& getStrings() const { return strings; }
+
+    template <typename T>
+    void put(T value) {
+        append(out, value);
+    }
+
+    // Symbols are process specific, so they are stored as indices into a
+    // string table written ahead of everything that refers to it.
+    void putSymbol(Symbol symbol) {
+        auto it = stringIndex.find(symbol);
+        if (it == stringIndex.end()) {
+            it = stringIndex.emplace(symbol, static_cast<uint32_t>(strings.size())).first;
+            strings.push_back(symbol);
+        }
+        put<uint32_t>(it->second);
+    }
+
+    void putCount(size_t count) {
+        put<uint32_t>(static_cast<uint32_t>(count));
+    }
+
+    // A tag, then either the 64-bit value or the decimal digits of a big one.
+    void putNumber(const Value& value) {
+        if (value.isBig()) {
+            put<uint8_t>(1);
+            std::string digits = value.toString();
+            putCount(digits.size());
+            out.append(digits);
+        } else {
+            put<uint8_t>(0);
+            put<int64_t>(value.asInt());
+        }
+    }
+
+    void writeCompiled(const CompiledFunction& function) {
+        putSymbol(function.name);
+        putCount(function.params.size());
+        for (Symbol param : function.params) {
+            putSymbol(param);
+        }
+        put<uint64_t>(function.frameSize);
+        put<uint8_t>(function.pure ? 1 : 0);
+
+        putCount(function.code.size());
+        out.append(reinterpret_cast<const char*>(function.code.data()), function.code.size() * sizeof(Instruction));
+
+        putCount(function.constants.size());
+        for (const Value& constant : function.constants) {
+            putNumber(constant);
+        }
+
+        putCount(function.calls.size());
+        for (const CallSite& site : function.calls) {
+            putSymbol(site.callee);
+            put<uint32_t>(site.argc);
+        }
+
+        putCount(function.outers.size());
+        for (const OuterRef& ref : function.outers) {
+            put<uint32_t>(ref.depth);
+            put<uint32_t>(ref.slot);
+            putSymbol(ref.name);
+        }
+
+        putCount(function.nested.size());
+        for (const auto& nested : function.nested) {
+            writeCompiled(*nested);
+        }
+    }
+
+    void visit(ExprAST& expr) override {
+        (void)expr;
+    }
+
+    void visit(NumberAST& number) override {
+        put(ExprTag::Number);
+        putNumber(number.getValue());
+    }
+
+    void visit(IdentifierAST& identifier) override {
+        put(ExprTag::Identifier);
+        putSymbol(identifier.getName());
+        put<int32_t>(identifier.getDepth());
+        put<int32_t>(identifier.getSlot());
+    }
+
+    void visit(BinaryOpAST& binary) override {
+        put(ExprTag::Binary);
+        put(binary.getOp());
+        binary.getLeft()->accept(*this);
+        binary.getRight()->accept(*this);
+    }
+
+    void visit(TernaryExprAST& ternary) override {
+        put(ExprTag::Ternary);
+        ternary.getCondition()->accept(*this);
+        ternary.getThenExpr()->accept(*this);
+        ternary.getElseExpr()->accept(*this);
+    }
+
+    void visit(FunctionCallAST& call) override {
+        put(ExprTag::Call);
+        putSymbol(call.getCallee());
+        putCount(call.getArgs().size());
+        for (ExprAST* arg : call.getArgs()) {
+            arg->accept(*this);
+        }
+    }
+
+    void visit(StatementAST& stmt) override {
+        (void)stmt;
+    }
+
+    void visit(AssignmentAST& assignment) override {
+        put(StmtTag::Assignment);
+        putSymbol(assignment.getVariable());
+        put<int32_t>(assignment.getSlot());
+        assignment.getValue()->accept(*this);
+    }
+
+    void visit(ReturnStmtAST& returnStmt) override {
+        put(StmtTag::Return);
+        returnStmt.getReturnExpr()->accept(*this);
+    }
+
+    void visit(FunctionDefAST& functionDef) override {
+        put(StmtTag::FunctionDef);
+        writeFunction(functionDef);
+    }
+
+    void writeFunction(FunctionDefAST& functionDef) {
+        putSymbol(functionDef.getName());
+        putCount(functionDef.getParams().size());
+        for (Symbol param : functionDef.getParams()) {
+            putSymbol(param);
+        }
+        put<uint64_t>(functionDef.getFrameSize());
+        put<uint8_t>(functionDef.isPure() ? 1 : 0);
+
+        putCount(functionDef.getBody().size());
+        for (StatementAST* stmt : functionDef.getBody()) {
+            stmt->accept(*this);
+        }
+        functionDef.getReturnExpr()->accept(*this);
+    }
+};
+
+
+// Decodes a section with every read bounds checked, so a damaged file is
+// reported as CorruptCache rather than read out of range.
+class CacheReader {
+    const char* pos;
+    const char* end;
+    const std::vector<Symbol>* strings = nullptr;
+
+public:
+    explicit CacheReader(std::string_view section) : pos(section.data()), end(section.data() + section.size()) {}
+
+    void setStrings(const std::vector<Symbol>& table) { strings = &table; }
+
+    template <typename T>
+    T get() {
+        if (static_cast<size_t>(end - pos) < sizeof(T)) {
+            throw CorruptCache();
+        }
+        T value;
+        std::memcpy(&value, pos, sizeof(T));
+        pos += sizeof(T);
+        return value;
+    }
+
+    // Counts are checked against the bytes left so that a bad count cannot
+    // trigger a huge allocation.
+    size_t getCount(size_t minimumItemSize) {
+        size_t count = get<uint32_t>();
+        if (count > static_cast<size_t>(end - pos) / minimumItemSize) {
+            throw CorruptCache();
+        }
+        return count;
+    }
+
+    Symbol getSymbol() {
+        uint32_t index = get<uint32_t>();
+        if (index >= strings->size()) {
+            throw CorruptCache();
+        }
+        return (*strings)[index];
+    }
+
+    bool atEnd() const { return pos == end; }
+
+    Value getNumber() {
+        switch (get<uint8_t>()) {
+            case 0:
+                return Value(get<int64_t>());
+            case 1: {
+                size_t length = getCount(1);
+                Value value;
+                if (!Value::parse(std::string_view(pos, length), value) || !value.isBig()) {
+                    throw CorruptCache();
+                }
+                pos += length;
+                return value;
+            }
+        }
+        throw CorruptCache();
+    }
+
+    void readStrings(std::vector<Symbol>& table) {
+        size_t count = getCount(sizeof(uint32_t));
+        table.reserve(count);
+        SymbolTable::global().reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            size_t length = get<uint32_t>();
+            if (length > static_cast<size_t>(end - pos)) {
+                throw CorruptCache();
+            }
+            table.push_back(SymbolTable::global().intern(std::string_view(pos, length)));
+            pos += length;
+        }
+        setStrings(table);
+    }
+
+    std::unique_ptr<CompiledFunction> readCompiled() {
+        auto function = std::make_unique<CompiledFunction>();
+        function->name = getSymbol();
+
+        size_t paramCount = getCount(sizeof(uint32_t));
+        function->params.reserve(paramCount);
+        for (size_t i = 0; i < paramCount; i++) {
+            function->params.push_back(getSymbol());
+        }
+
+        function->frameSize = get<uint64_t>();
+        function->pure = get<uint8_t>() != 0;
+
+        size_t codeCount = getCount(sizeof(Instruction));
+        function->code.resize(codeCount);
+        std::memcpy(function->code.data(), pos, codeCount * sizeof(Instruction));
+        pos += codeCount * sizeof(Instruction);
+
+        size_t constantCount = getCount(1 + sizeof(uint32_t));
+        function->constants.reserve(constantCount);
+        for (size_t i = 0; i < constantCount; i++) {
+            function->constants.push_back(getNumber());
+        }
+
+        size_t callCount = getCount(2 * sizeof(uint32_t));
+        function->calls.reserve(callCount);
+        for (size_t i = 0; i < callCount; i++) {
+            CallSite site;
+            site.callee = getSymbol();
+            site.argc = get<uint32_t>();
+            function->calls.push_back(site);
+        }
+
+        size_t outerCount = getCount(3 * sizeof(uint32_t));
+        function->outers.reserve(outerCount);
+        for (size_t i = 0; i < outerCount; i++) {
+            OuterRef ref;
+            ref.depth = get<uint32_t>();
+            ref.slot = get<uint32_t>();
+            ref.name = getSymbol();
+            function->outers.push_back(ref);
+        }
+
+        size_t nestedCount = getCount(1);
+        function->nested.reserve(nestedCount);
+        for (size_t i = 0; i < nestedCount; i++) {
+            function->nested.push_back(readCompiled());
+        }
+
+        return function;
+    }
+};
+
+
+class ASTReader : public CacheReader {
+    Arena& arena;
+    std::vector<ExprAST*> exprScratch;
+    std::vector<StatementAST*> stmtScratch;
+
+public:
+    ASTReader(std::string_view section, const std::vector<Symbol>& table, Arena& arena)
+        : CacheReader(section), arena(arena) {
+        setStrings(table);
+    }
+
+    ExprAST* readExpr() {
+        switch (get<ExprTag>()) {
+            case ExprTag::Number: {
+                Value value = getNumber();
+                if (value.isBig()) {
+                    return arena.make<NumberAST>(arena.copyString(value.toString()));
+                }
+                return arena.make<NumberAST>(value.asInt());
+            }
+
+            case ExprTag::Identifier: {
+                auto identifier = arena.make<IdentifierAST>(getSymbol());
+                int depth = get<int32_t>();
+                int slot = get<int32_t>();
+                identifier->setResolved(depth, slot);
+                return identifier;
+            }
+
+            case ExprTag::Binary: {
+                char op = get<char>();
+                ExprAST* left = readExpr();
+                ExprAST* right = readExpr();
+                return arena.make<BinaryOpAST>(op, left, right);
+            }
+
+            case ExprTag::Ternary: {
+                ExprAST* condition = readExpr();
+                ExprAST* then_expr = readExpr();
+                ExprAST* else_expr = readExpr();
+                return arena.make<TernaryExprAST>(condition, then_expr, else_expr);
+            }
+
+            case ExprTag::Call: {
+                Symbol callee = getSymbol();
+                size_t argc = getCount(1);
+                size_t start = exprScratch.size();
+                for (size_t i = 0; i < argc; i++) {
+                    exprScratch.push_back(readExpr());
+                }
+                return arena.make<FunctionCallAST>(callee, takeScratch(exprScratch, start));
+            }
+        }
+        throw CorruptCache();
+    }
+
+    StatementAST* readStatement() {
+        switch (get<StmtTag>()) {
+            case StmtTag::Assignment: {
+                Symbol variable = getSymbol();
+                int slot = get<int32_t>();
+                auto assignment = arena.make<AssignmentAST>(variable, readExpr());
+                assignment->setSlot(slot);
+                return assignment;
+            }
+
+            case StmtTag::FunctionDef:
+                return readFunction();
+
+            case StmtTag::Return:
+                return arena.make<ReturnStmtAST>(readExpr());
+        }
+        throw CorruptCache();
+    }
+
+    FunctionDefAST* readFunction() {
+        Symbol name = getSymbol();
+
+        size_t paramCount = getCount(sizeof(uint32_t));
+        Symbol* params = arena.allocateArray<Symbol>(paramCount);
+        for (size_t i = 0; i < paramCount; i++) {
+            params[i] = getSymbol();
+        }
+
+        size_t frameSize = get<uint64_t>();
+        bool pure = get<uint8_t>() != 0;
+
+        size_t bodyCount = getCount(1);
+        size_t start = stmtScratch.size();
+        for (size_t i = 0; i < bodyCount; i++) {
+            stmtScratch.push_back(readStatement());
+        }
+        ArenaSpan<StatementAST*> body = takeScratch(stmtScratch, start);
+        ExprAST* return_expr = readExpr();
+
+        auto function = arena.make<FunctionDefAST>(
+            name, ArenaSpan<Symbol>(params, paramCount), body, return_expr);
+        function->setFrameSize(frameSize);
+        function->setPure(pure);
+        return function;
+    }
+
+private:
+    template <typename T>
+    ArenaSpan<T> takeScratch(std::vector<T>& scratch, size_t start) {
+        auto list = copyToArena<T>(arena, scratch.begin() + start, scratch.end());
+        scratch.resize(start);
+        return list;
+    }
+};
+
+}
+
+uint64_t ProgramCache::hashSource(std::string_view source) {
+    return hashBytes(source.data(), source.size());
+}
+
+bool ProgramCache::read(const std::string& path, std::string_view source, bool optimize, size_t inlineLimit,
+                        Program& program) {
+    auto cached = std::make_unique<CachedAST>();
+    if (!cached->file.open(path)) {
+        return false;
+    }
+
+    std::string_view data = cached->file.view();
+    Header header;
+    if (data.size() < sizeof(Header)) {
+        return false;
+    }
+    std::memcpy(&header, data.data(), sizeof(Header));
+    data.remove_prefix(sizeof(Header));
+
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        header.version != VERSION ||
+        header.byteOrder != ENDIAN_MARK ||
+        header.flags != (optimize ? FLAG_OPTIMIZED : 0) ||
+        header.inlineLimit != (optimize ? inlineLimit : 0) ||
+        header.sourceSize != source.size() ||
+        header.payloadSize > data.size() ||
+        header.astSize != data.size() - header.payloadSize) {
+        return false;
+    }
+
+    // Both sections are checked up front so that a damaged file still falls
+    // back to the source; decoding the AST later can then only fail on a bug.
+    std::string_view payload = data.substr(0, header.payloadSize);
+    std::string_view astSection = data.substr(header.payloadSize);
+    if (header.sourceHash != hashSource(source) ||
+        header.payloadHash != hashBytes(payload.data(), payload.size()) ||
+        header.astHash != hashBytes(astSection.data(), astSection.size())) {
+        return false;
+    }
+
+    try {
+        std::vector<std::unique_ptr<CompiledFunction>> compiled;
+        CacheReader reader(payload);
+
+        reader.readStrings(cached->strings);
+
+        size_t count = reader.getCount(1);
+        compiled.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            compiled.push_back(reader.readCompiled());
+        }
+
+        if (!reader.atEnd()) {
+            return false;
+        }
+
+        cached->section = astSection;
+        cached->functionCount = count;
+
+        program.compiled = std::move(compiled);
+        program.cachedAST = std::move(cached);
+        program.defineGlobals();
+        return true;
+    } catch (const CorruptCache&) {
+        return false;
+    }
+}
+
+void ProgramCache::readAST(const CachedAST& cached, ProgramAST& ast) {
+    try {
+        ProgramAST decoded;
+        ASTReader reader(cached.section, cached.strings, decoded.getArena());
+        for (size_t i = 0; i < cached.functionCount; i++) {
+            decoded.addFunction(reader.readFunction());
+        }
+        if (!reader.atEnd()) {
+            throw CorruptCache();
+        }
+        ast = std::move(decoded);
+    } catch (const CorruptCache&) {
+        throw RuntimeError("Corrupt program cache");
+    }
+}
+
+bool ProgramCache::write(const std::string& path, std::string_view source, bool optimize, size_t inlineLimit,
+                         const Program& program) {
+    // Everything that refers to a string is encoded first, then the string
+    // table is put in front of it.
+    std::string body;
+    CacheWriter writer(body);
+
+    writer.putCount(program.getCompiled().size());
+    for (const auto& function : program.getCompiled()) {
+        writer.writeCompiled(*function);
+    }
+    size_t astStart = body.size();
+    for (FunctionDefAST* func : program.getFunctions()) {
+        writer.writeFunction(*func);
+    }
+
+    std::string payload;
+    append<uint32_t>(payload, static_cast<uint32_t>(writer.getStrings().size()));
+    for (Symbol symbol : writer.getStrings()) {
+        std::string name = symbolName(symbol);
+        append<uint32_t>(payload, static_cast<uint32_t>(name.size()));
+        payload += name;
+    }
+    payload.append(body, 0, astStart);
+    std::string_view ast = std::string_view(body).substr(astStart);
+
+    Header header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.byteOrder = ENDIAN_MARK;
+    header.flags = optimize ? FLAG_OPTIMIZED : 0;
+    header.inlineLimit = optimize ? inlineLimit : 0;
+    header.sourceSize = source.size();
+    header.sourceHash = hashSource(source);
+    header.payloadSize = payload.size();
+    header.payloadHash = hashBytes(payload.data(), payload.size());
+    header.astSize = ast.size();
+    header.astHash = hashBytes(ast.data(), ast.size());
+
+    std::string temp = path + ".tmp";
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            return false;
+        }
+        out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+        out.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+        out.write(ast.data(), static_cast<std::streamsize>(ast.size()));
+        if (!out) {
+            out.close();
+            std::remove(temp.c_str());
+            return false;
+        }
+    }
+
+#ifdef _WIN32
+    // rename does not replace an existing file on Windows.
+    std::remove(path.c_str());
+#endif
+    if (std::rename(temp.c_str(), path.c_str()) != 0) {
+        std::remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,117 @@
+#include "purity.h"
+#include <map>
+
+void PurityAnalysis::analyze(ProgramAST& program) {
+    PurityAnalysis analysis;
+    std::map<Symbol, size_t> globals;
+
+    // A later top-level def replaces an earlier one of the same name, as it
+    // does when the program is loaded.
+    for (FunctionDefAST* func : program.getFunctions()) {
+        globals[func->getName()] = analysis.summaries.size();
+        func->accept(analysis);
+    }
+
+    std::vector<bool> pure(analysis.summaries.size());
+    for (size_t i = 0; i < pure.size(); i++) {
+        const Summary& summary = analysis.summaries[i];
+        pure[i] = !summary.readsOuter;
+        for (Symbol callee : summary.calls) {
+            if (analysis.nestedNames.count(callee) || !globals.count(callee)) {
+                pure[i] = false;
+            }
+        }
+    }
+
+    // Anything calling an impure function is impure itself; repeat until
+    // nothing changes so that mutual recursion settles.
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 0; i < pure.size(); i++) {
+            if (!pure[i]) {
+                continue;
+            }
+            for (Symbol callee : analysis.summaries[i].calls) {
+                if (!pure[globals[callee]]) {
+                    pure[i] = false;
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < pure.size(); i++) {
+        analysis.summaries[i].function->setPure(pure[i]);
+    }
+}
+
+void PurityAnalysis::visit(ExprAST& expr) {
+    (void)expr;
+}
+
+void PurityAnalysis::visit(NumberAST& number) {
+    (void)number;
+}
+
+void PurityAnalysis::visit(IdentifierAST& identifier) {
+    // A read `depth` levels out escapes every open function that is fewer
+    // than `depth` levels out from here.
+    size_t depth = static_cast<size_t>(identifier.getDepth());
+    for (size_t level = 0; level < open.size() && level < depth; level++) {
+        summaries[open[open.size() - 1 - level]].readsOuter = true;
+    }
+}
+
+void PurityAnalysis::visit(BinaryOpAST& binary) {
+    binary.getLeft()->accept(*this);
+    binary.getRight()->accept(*this);
+}
+
+void PurityAnalysis::visit(TernaryExprAST& ternary) {
+    ternary.getCondition()->accept(*this);
+    ternary.getThenExpr()->accept(*this);
+    ternary.getElseExpr()->accept(*this);
+}
+
+void PurityAnalysis::visit(FunctionCallAST& call) {
+    for (size_t index : open) {
+        summaries[index].calls.insert(call.getCallee());
+    }
+    for (ExprAST* arg : call.getArgs()) {
+        arg->accept(*this);
+    }
+}
+
+void PurityAnalysis::visit(StatementAST& stmt) {
+    (void)stmt;
+}
+
+void PurityAnalysis::visit(AssignmentAST& assignment) {
+    assignment.getValue()->accept(*this);
+}
+
+void PurityAnalysis::visit(ReturnStmtAST& returnStmt) {
+    returnStmt.getReturnExpr()->accept(*this);
+}
+
+void PurityAnalysis::visit(FunctionDefAST& functionDef) {
+    if (!open.empty()) {
+        nestedNames.insert(functionDef.getName());
+    }
+
+    Summary summary;
+    summary.function = &functionDef;
+    summaries.push_back(std::move(summary));
+    open.push_back(summaries.size() - 1);
+
+    for (StatementAST* stmt : functionDef.getBody()) {
+        stmt->accept(*this);
+    }
+    if (functionDef.getReturnExpr()) {
+        functionDef.getReturnExpr()->accept(*this);
+    }
+
+    open.pop_back();
+}
@@ -0,0 +1,218 @@
+#include "resolver.h"
+#include "error.h"
+
+namespace {
+
+const ExprAST* statementValue(const StatementAST* stmt) {
+    if (auto assignment = dynamic_cast<const AssignmentAST*>(stmt)) {
+        return assignment->getValue();
+    }
+    if (auto returnStmt = dynamic_cast<const ReturnStmtAST*>(stmt)) {
+        return returnStmt->getReturnExpr();
+    }
+    return nullptr;
+}
+
+// Calls in `expr` to `callee`, or to any function when it is null.
+size_t countCalls(const ExprAST* expr, const Symbol* callee) {
+    if (auto binary = dynamic_cast<const BinaryOpAST*>(expr)) {
+        return countCalls(binary->getLeft(), callee) + countCalls(binary->getRight(), callee);
+    }
+    if (auto ternary = dynamic_cast<const TernaryExprAST*>(expr)) {
+        return countCalls(ternary->getCondition(), callee) + countCalls(ternary->getThenExpr(), callee) +
+               countCalls(ternary->getElseExpr(), callee);
+    }
+    if (auto call = dynamic_cast<const FunctionCallAST*>(expr)) {
+        size_t count = !callee || call->getCallee() == *callee ? 1 : 0;
+        for (const ExprAST* arg : call->getArgs()) {
+            count += countCalls(arg, callee);
+        }
+        return count;
+    }
+    return 0;
+}
+
+size_t countCalls(const FunctionDefAST& function, Symbol callee, bool nested) {
+    size_t count = countCalls(function.getReturnExpr(), &callee);
+    for (const StatementAST* stmt : function.getBody()) {
+        if (auto def = dynamic_cast<const FunctionDefAST*>(stmt)) {
+            count += nested ? countCalls(*def, callee, true) : 0;
+        } else if (const ExprAST* value = statementValue(stmt)) {
+            count += countCalls(value, &callee);
+        }
+    }
+    return count;
+}
+
+}
+
+void Resolver::resolve(ProgramAST& program) {
+    this->program = &program;
+    for (FunctionDefAST* func : program.getFunctions()) {
+        resolveFunction(*func);
+    }
+}
+
+void Resolver::resolveFunction(FunctionDefAST& functionDef) {
+    Scope current;
+    current.function = &functionDef;
+    current.enclosing = scope;
+
+    int frameSize = 0;
+
+    for (Symbol param : functionDef.getParams()) {
+        // A repeated parameter name binds to the last occurrence, exactly
+        // like successive definitions did in the old environment map.
+        current.slots[param] = frameSize++;
+        current.bound.insert(param);
+    }
+
+    for (StatementAST* stmt : functionDef.getBody()) {
+        if (auto assignment = dynamic_cast<AssignmentAST*>(stmt)) {
+            if (current.slots.find(assignment->getVariable()) == current.slots.end()) {
+                current.slots[assignment->getVariable()] = frameSize++;
+            }
+        }
+    }
+
+    functionDef.setFrameSize(static_cast<size_t>(frameSize));
+
+    scope = &current;
+    for (StatementAST* stmt : functionDef.getBody()) {
+        stmt->accept(*this);
+        current.position++;
+    }
+    if (functionDef.getReturnExpr()) {
+        functionDef.getReturnExpr()->accept(*this);
+    }
+    scope = current.enclosing;
+}
+
+void Resolver::visit(ExprAST& expr) {
+    (void)expr;
+}
+
+void Resolver::visit(NumberAST& number) {
+    (void)number;
+}
+
+void Resolver::visit(IdentifierAST& identifier) {
+    Symbol name = identifier.getName();
+
+    if (scope->bound.count(name)) {
+        identifier.setResolved(0, scope->slots[name]);
+        return;
+    }
+
+    // An enclosing function is resolving the def of `inner` when this is
+    // reached, so its `bound` holds what it had assigned before that def.
+    int depth = 1;
+    Scope* inner = scope;
+    int unusedDepth = 0;
+    int unusedSlot = -1;
+    for (Scope* outer = scope->enclosing; outer; inner = outer, outer = outer->enclosing, depth++) {
+        auto it = outer->slots.find(name);
+        if (it == outer->slots.end()) {
+            continue;
+        }
+        if (outer->bound.count(name)) {
+            identifier.setResolved(depth, it->second);
+            return;
+        }
+
+        // Assigned only after the def: calls made before the assignment see
+        // a variable further out, calls made after it see this one.
+        int timing = whenCalled(*outer, *inner->function, name);
+        if (timing == (BEFORE | AFTER)) {
+            throw NameError("Variable " + symbolName(name) + " in function " +
+                            symbolName(scope->function->getName()) + " depends on when " +
+                            symbolName(inner->function->getName()) + " is called");
+        }
+        if (timing == AFTER) {
+            identifier.setResolved(depth, it->second);
+            return;
+        }
+        if (timing == NEVER && unusedSlot < 0) {
+            unusedDepth = depth;
+            unusedSlot = it->second;
+        }
+    }
+
+    // A function that is never called may read a variable its definer only
+    // assigns later.
+    if (unusedSlot >= 0) {
+        identifier.setResolved(unusedDepth, unusedSlot);
+        return;
+    }
+
+    throw NameError("Undefined variable: " + symbolName(name) +
+                    " in function " + symbolName(scope->function->getName()));
+}
+
+// Whether `nested`, defined by the statement `definer` is at, may run
+// before or after `name` is next assigned there. It can only run while the
+// definer does, during a statement that makes a call: one to it directly,
+// or any call at all when something other than the definer and `nested`
+// itself calls a function of its name.
+int Resolver::whenCalled(const Scope& definer, const FunctionDefAST& nested, Symbol name) const {
+    const ArenaSpan<StatementAST*>& body = definer.function->getBody();
+    size_t assigned = definer.position + 1;
+    while (assigned < body.size()) {
+        auto assignment = dynamic_cast<const AssignmentAST*>(body[assigned]);
+        if (assignment && assignment->getVariable() == name) {
+            break;
+        }
+        assigned++;
+    }
+
+    Symbol callee = nested.getName();
+    size_t elsewhere = 0;
+    for (const FunctionDefAST* func : program->getFunctions()) {
+        elsewhere += countCalls(*func, callee, true);
+    }
+    elsewhere -= countCalls(*definer.function, callee, false) + countCalls(nested, callee, true);
+
+    int timing = NEVER;
+    for (size_t i = definer.position + 1; i <= body.size(); i++) {
+        const ExprAST* value = i < body.size() ? statementValue(body[i]) : definer.function->getReturnExpr();
+        if (value && (countCalls(value, &callee) || (elsewhere && countCalls(value, nullptr)))) {
+            timing |= i <= assigned ? BEFORE : AFTER;
+        }
+    }
+    return timing;
+}
+
+void Resolver::visit(BinaryOpAST& binary) {
+    binary.getLeft()->accept(*this);
+    binary.getRight()->accept(*this);
+}
+
+void Resolver::visit(TernaryExprAST& ternary) {
+    ternary.getCondition()->accept(*this);
+    ternary.getThenExpr()->accept(*this);
+    ternary.getElseExpr()->accept(*this);
+}
+
+void Resolver::visit(FunctionCallAST& call) {
+    for (ExprAST* arg : call.getArgs()) {
+        arg->accept(*this);
+    }
+}
+
+void Resolver::visit(StatementAST& stmt) {
+    (void)stmt;
+}
+
+void Resolver::visit(AssignmentAST& assignment) {
+    assignment.getValue()->accept(*this);
+    assignment.setSlot(scope->slots[assignment.getVariable()]);
+    scope->bound.insert(assignment.getVariable());
+}
+
+void Resolver::visit(ReturnStmtAST& returnStmt) {
+    returnStmt.getReturnExpr()->accept(*this);
+}
+
+void Resolver::visit(FunctionDefAST& functionDef) {
+    resolveFunction(functionDef);
+}
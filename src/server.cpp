@@ -0,0 +1,207 @@
+#include "server.h"
+#include "error.h"
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+bool isSpace(char c) {
+    return std::isspace(static_cast<unsigned char>(c)) != 0;
+}
+
+std::string_view nextField(std::string_view& text) {
+    size_t start = 0;
+    while (start < text.size() && isSpace(text[start])) {
+        start++;
+    }
+    size_t end = start;
+    while (end < text.size() && !isSpace(text[end])) {
+        end++;
+    }
+    std::string_view field = text.substr(start, end - start);
+    text.remove_prefix(end);
+    return field;
+}
+
+#ifndef _WIN32
+
+bool writeAll(int fd, const std::string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+#endif
+
+}
+
+Server::Server(std::shared_ptr<const Program> program, Engine engine)
+    : program(std::move(program)), engine(engine) {}
+
+std::unique_ptr<ExecutionContext> Server::createContext() {
+    auto context = std::make_unique<ExecutionContext>(program, engine);
+    if (memoCapacity > 0) {
+        context->enableMemoization(memoCapacity);
+    }
+    context->setLimits(limits);
+    context->setStackLimit(stackLimit);
+    return context;
+}
+
+std::string Server::handle(ExecutionContext& context, std::string_view request) {
+    std::string_view name = nextField(request);
+    if (name.empty()) {
+        return "ERR Error: Empty request";
+    }
+
+    std::vector<Value> args;
+    for (std::string_view field = nextField(request); !field.empty(); field = nextField(request)) {
+        Value value;
+        if (!Value::parse(field, value)) {
+            return "ERR Error: Invalid argument '" + std::string(field) + "', expected integer";
+        }
+        args.push_back(value);
+    }
+
+    try {
+        Symbol symbol;
+        if (!program->lookup(name, symbol)) {
+            throw NameError("Function not found: " + std::string(name));
+        }
+        return "OK " + context.run(symbol, args).toString();
+    } catch (...) {
+        return "ERR " + describeError(std::current_exception());
+    }
+}
+
+void Server::serve(std::istream& in, std::ostream& out) {
+    auto context = createContext();
+    std::string line;
+
+    while (std::getline(in, line)) {
+        out << handle(*context, line) << '\n';
+
+        // Requests that are already buffered are answered before flushing,
+        // so a pipelined burst goes out in one write.
+        if (in.rdbuf()->in_avail() <= 0) {
+            out.flush();
+        }
+    }
+    out.flush();
+}
+
+#ifdef _WIN32
+
+void Server::serveSocket(const std::string& path) {
+    (void)path;
+    throw std::runtime_error("Unix domain sockets are not supported on this platform");
+}
+
+void Server::serveConnection(int fd) {
+    (void)fd;
+}
+
+#else
+
+void Server::serveSocket(const std::string& path) {
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Socket path too long: " + path);
+    }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    // A socket file left behind by an earlier server would make bind fail,
+    // so it is removed; anything else at the path is left alone.
+    struct stat existing;
+    if (::lstat(path.c_str(), &existing) == 0) {
+        if (!S_ISSOCK(existing.st_mode)) {
+            throw std::runtime_error("Could not listen on " + path + ": not a socket");
+        }
+        ::unlink(path.c_str());
+    }
+
+    int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        throw std::runtime_error("Could not create socket: " + std::string(std::strerror(errno)));
+    }
+    if (::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        ::listen(listener, SOMAXCONN) != 0) {
+        std::string reason = std::strerror(errno);
+        ::close(listener);
+        throw std::runtime_error("Could not listen on " + path + ": " + reason);
+    }
+
+    // A client that disconnects early must not kill the server.
+    std::signal(SIGPIPE, SIG_IGN);
+
+    for (;;) {
+        int fd = ::accept(listener, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            std::string reason = std::strerror(errno);
+            ::close(listener);
+            throw std::runtime_error("Could not accept connection: " + reason);
+        }
+        std::thread(&Server::serveConnection, this, fd).detach();
+    }
+}
+
+void Server::serveConnection(int fd) {
+    auto context = createContext();
+    std::string input;
+    std::string output;
+    char buffer[65536];
+
+    for (;;) {
+        ssize_t n = ::read(fd, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        input.append(buffer, static_cast<size_t>(n));
+
+        // Every complete request in this read is answered, then all replies
+        // are sent together.
+        size_t start = 0;
+        for (size_t newline; (newline = input.find('\n', start)) != std::string::npos; start = newline + 1) {
+            output += handle(*context, std::string_view(input).substr(start, newline - start));
+            output += '\n';
+        }
+        input.erase(0, start);
+
+        if (!writeAll(fd, output)) {
+            break;
+        }
+        output.clear();
+    }
+
+    ::close(fd);
+}
+
+#endif
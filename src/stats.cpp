@@ -0,0 +1,100 @@
+#include "stats.h"
+#include <algorithm>
+#include <iomanip>
+
+namespace {
+
+const char* const NODE_NAMES[RuntimeStats::NODE_KINDS] = {
+    "number", "identifier", "binary op", "ternary", "call", "assignment", "return", "function def",
+};
+
+const char* const OPCODE_NAMES[RuntimeStats::OPCODES] = {
+    "PUSH_CONST", "LOAD_LOCAL", "LOAD_OUTER", "STORE_LOCAL", "ADD", "SUB", "MUL", "DIV", "EQ", "NOT_EQ", "LESS",
+    "JUMP", "JUMP_IF_FALSE", "LOAD_FUNC", "CALL", "TAIL_CALL", "DEFINE_FUNC", "POP", "RETURN",
+};
+
+}
+
+thread_local RuntimeStats* RuntimeStats::active = nullptr;
+
+RuntimeStats& RuntimeStats::unscoped() {
+    thread_local RuntimeStats stats;
+    return stats;
+}
+
+void RuntimeStats::merge(const RuntimeStats& other) {
+    for (size_t i = 0; i < NODE_KINDS; i++) {
+        nodes[i] += other.nodes[i];
+    }
+    environments += other.environments;
+    evaluators += other.evaluators;
+
+    for (size_t i = 0; i < OPCODES; i++) {
+        instructions[i] += other.instructions[i];
+    }
+    frames += other.frames;
+
+    variableLookups += other.variableLookups;
+    variableHops += other.variableHops;
+    functionLookups += other.functionLookups;
+    functionHops += other.functionHops;
+    slotsAllocated += other.slotsAllocated;
+    tailCalls += other.tailCalls;
+    peakDepth = std::max(peakDepth, other.peakDepth);
+}
+
+void RuntimeStats::write(std::ostream& out) const {
+    auto line = [&out](const char* name, uint64_t value) {
+        out << "  " << std::left << std::setw(22) << name << std::right << std::setw(14) << value << '\n';
+    };
+    auto average = [](uint64_t total, uint64_t count) {
+        return count == 0 ? 0.0 : static_cast<double>(total) / static_cast<double>(count);
+    };
+
+    std::ios::fmtflags flags = out.flags();
+
+    uint64_t visited = 0;
+    for (uint64_t count : nodes) {
+        visited += count;
+    }
+    if (visited > 0) {
+        out << "AST nodes visited:\n";
+        for (size_t i = 0; i < NODE_KINDS; i++) {
+            if (nodes[i] > 0) {
+                line(NODE_NAMES[i], nodes[i]);
+            }
+        }
+        line("environments", environments);
+        line("evaluators", evaluators);
+    }
+
+    uint64_t executed = 0;
+    for (uint64_t count : instructions) {
+        executed += count;
+    }
+    if (executed > 0) {
+        out << "Instructions executed:\n";
+        for (size_t i = 0; i < OPCODES; i++) {
+            if (instructions[i] > 0) {
+                line(OPCODE_NAMES[i], instructions[i]);
+            }
+        }
+        line("frames", frames);
+    }
+
+    out << "Lookups:\n";
+    line("variables", variableLookups);
+    line("variable hops", variableHops);
+    line("functions", functionLookups);
+    line("function hops", functionHops);
+    out << std::fixed << std::setprecision(2)
+        << "  hops per variable     " << std::setw(14) << average(variableHops, variableLookups) << '\n'
+        << "  hops per function     " << std::setw(14) << average(functionHops, functionLookups) << '\n';
+
+    out << "Frames:\n";
+    line("slots allocated", slotsAllocated);
+    line("tail calls", tailCalls);
+    line("peak depth", peakDepth);
+
+    out.flags(flags);
+}
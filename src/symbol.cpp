@@ -0,0 +1,50 @@
+#include "symbol.h"
+
+SymbolTable::SymbolTable() {
+    intern("def");
+    intern("return");
+    intern("if");
+    intern("then");
+    intern("else");
+}
+
+SymbolTable& SymbolTable::global() {
+    static SymbolTable table;
+    return table;
+}
+
+Symbol SymbolTable::intern(std::string_view name) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = index.find(name);
+    if (it != index.end()) {
+        return it->second;
+    }
+
+    // Deque elements never move, so the stored string can back the key.
+    names.emplace_back(name);
+    Symbol symbol = static_cast<Symbol>(names.size() - 1);
+    index.emplace(names.back(), symbol);
+    return symbol;
+}
+
+void SymbolTable::reserve(size_t count) {
+    std::lock_guard<std::mutex> lock(mutex);
+    index.reserve(names.size() + count);
+}
+
+bool SymbolTable::lookup(std::string_view name, Symbol& symbol) const {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = index.find(name);
+    if (it == index.end()) {
+        return false;
+    }
+    symbol = it->second;
+    return true;
+}
+
+std::string SymbolTable::name(Symbol symbol) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return symbol < names.size() ? names[symbol] : std::string();
+}
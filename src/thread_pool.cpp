@@ -0,0 +1,117 @@
+#include "thread_pool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t threads) {
+    if (threads == 0) {
+        threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+
+    for (size_t i = 0; i < threads; i++) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < threads; i++) {
+        workers[i]->thread = std::thread(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (auto& worker : workers) {
+        worker->thread.join();
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, size_t grain, const RangeTask& body) {
+    if (count == 0) {
+        return;
+    }
+    grain = std::max<size_t>(1, grain);
+
+    // Consecutive ranges go to the same worker so that, without stealing,
+    // each thread walks one contiguous block of the input.
+    size_t ranges = (count + grain - 1) / grain;
+    size_t perWorker = (ranges + workers.size() - 1) / workers.size();
+    for (size_t r = 0; r < ranges; r++) {
+        Range range{r * grain, std::min(count, (r + 1) * grain)};
+        Worker& worker = *workers[r / perWorker];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.ranges.push_back(range);
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    task = &body;
+    busy = workers.size();
+    failure = nullptr;
+    generation++;
+    wake.notify_all();
+
+    done.wait(lock, [this] { return busy == 0; });
+    task = nullptr;
+
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+}
+
+bool ThreadPool::takeRange(size_t index, Range& range) {
+    {
+        Worker& own = *workers[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.ranges.empty()) {
+            range = own.ranges.front();
+            own.ranges.pop_front();
+            return true;
+        }
+    }
+
+    for (size_t offset = 1; offset < workers.size(); offset++) {
+        Worker& victim = *workers[(index + offset) % workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.ranges.empty()) {
+            range = victim.ranges.back();
+            victim.ranges.pop_back();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::workerLoop(size_t index) {
+    size_t seen = 0;
+
+    for (;;) {
+        const RangeTask* current;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+            current = task;
+        }
+
+        Range range;
+        while (takeRange(index, range)) {
+            try {
+                (*current)(index, range.begin, range.end);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!failure) {
+                    failure = std::current_exception();
+                }
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--busy == 0) {
+            done.notify_one();
+        }
+    }
+}
@@ -1,13 +1,40 @@
 #include "tokenzier.h"
 #include "error.h"
 #include <cctype>
+#include <iterator>
+#include <limits>
 
-Tokenizer::Tokenizer(std::istream* in) : in_(in), current_token_(UtilityTokens::EOFT) {
+namespace {
+
+bool IsDigit(char c) {
+    return std::isdigit(static_cast<unsigned char>(c)) != 0;
+}
+
+bool IsIdentifierStart(char c) {
+    return std::isalpha(static_cast<unsigned char>(c)) || c == '_';
+}
+
+bool IsIdentifierChar(char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+}
+
+Tokenizer::Tokenizer(std::istream* in)
+    : buffer_(std::istreambuf_iterator<char>(*in), std::istreambuf_iterator<char>()),
+      pos_(buffer_.data()), end_(buffer_.data() + buffer_.size()),
+      current_token_(UtilityTokens::EOFT) {
+    Next();
+}
+
+Tokenizer::Tokenizer(std::string_view source)
+    : pos_(source.data()), end_(source.data() + source.size()),
+      current_token_(UtilityTokens::EOFT) {
     Next();
 }
 
 bool Tokenizer::IsEnd() {
-    return std::holds_alternative<UtilityTokens>(current_token_) && 
+    return std::holds_alternative<UtilityTokens>(current_token_) &&
            std::get<UtilityTokens>(current_token_) == UtilityTokens::EOFT;
 }
 
@@ -17,135 +44,139 @@ Token Tokenizer::GetToken() {
 
 void Tokenizer::Next() {
     SkipWhitespace();
-    
-    if (in_->eof()) {
+
+    if (pos_ == end_) {
         current_token_ = UtilityTokens::EOFT;
         return;
     }
-    
-    int c = in_->peek();
-    
+
+    char c = *pos_;
+
     if (c == '\n') {
-        in_->get();
+        pos_++;
         current_token_ = UtilityTokens::NEWLINE;
         return;
     }
-    
-    if (std::isdigit(c)) {
+
+    if (IsDigit(c)) {
         current_token_ = ReadNumber();
         return;
     }
-    
-    if (std::isalpha(c) || c == '_') {
-        std::string identifier = ReadIdentifier();
-        
-        if (identifier == "def") {
-            current_token_ = UtilityTokens::DEF;
-        } else if (identifier == "return") {
-            current_token_ = UtilityTokens::RETURN;
-        } else if (identifier == "if") {
-            current_token_ = EmbracingToken::IF;
-        } else if (identifier == "then") {
-            current_token_ = EmbracingToken::THEN;
-        } else if (identifier == "else") {
-            current_token_ = EmbracingToken::ELSE;
-        } else {
-            current_token_ = SymbolToken{identifier};
+
+    if (IsIdentifierStart(c)) {
+        Symbol symbol = SymbolTable::global().intern(ReadIdentifier());
+
+        switch (symbol) {
+            case Keywords::DEF:
+                current_token_ = UtilityTokens::DEF;
+                break;
+            case Keywords::RETURN:
+                current_token_ = UtilityTokens::RETURN;
+                break;
+            case Keywords::IF:
+                current_token_ = EmbracingToken::IF;
+                break;
+            case Keywords::THEN:
+                current_token_ = EmbracingToken::THEN;
+                break;
+            case Keywords::ELSE:
+                current_token_ = EmbracingToken::ELSE;
+                break;
+            default:
+                current_token_ = SymbolToken{symbol};
+                break;
         }
-        
+
         return;
     }
-    
+
+    pos_++;
+
     switch (c) {
         case '(':
-            in_->get();
             current_token_ = EmbracingToken::LPAREN;
             return;
         case ')':
-            in_->get();
             current_token_ = EmbracingToken::RPAREN;
             return;
         case ',':
-            in_->get();
             current_token_ = EmbracingToken::COMMA;
             return;
         case '+':
-            in_->get();
             current_token_ = OperatorToken::PLUS;
             return;
         case '-':
-            in_->get();
             current_token_ = OperatorToken::MINUS;
             return;
         case '*':
-            in_->get();
             current_token_ = OperatorToken::MULTIPLY;
             return;
         case '/':
-            in_->get();
             current_token_ = OperatorToken::DIVIDE;
             return;
         case '<':
-            in_->get();
             current_token_ = OperatorToken::LESS;
             return;
         case '=':
-            in_->get();
-            if (in_->peek() == '=') {
-                in_->get();
+            if (pos_ != end_ && *pos_ == '=') {
+                pos_++;
                 current_token_ = OperatorToken::EQ_EQ;
             } else {
                 current_token_ = OperatorToken::EQ;
             }
             return;
         case '!':
-            in_->get();
-            if (in_->peek() == '=') {
-                in_->get();
+            if (pos_ != end_ && *pos_ == '=') {
+                pos_++;
                 current_token_ = OperatorToken::NOT_EQ;
             } else {
                 throw SyntaxError("Expected '=' after '!'");
             }
             return;
         default:
-            in_->get();
-            throw SyntaxError("Unknown character: " + std::string(1, static_cast<char>(c)));
+            throw SyntaxError("Unknown character: " + std::string(1, c));
     }
 }
 
 void Tokenizer::SkipWhitespace() {
-    while (!in_->eof() && (std::isspace(in_->peek()) && in_->peek() != '\n')) {
-        in_->get();
+    while (pos_ != end_ && std::isspace(static_cast<unsigned char>(*pos_)) && *pos_ != '\n') {
+        pos_++;
     }
-    
-    if (in_->peek() == '#') {
-        while (!in_->eof() && in_->peek() != '\n') {
-            in_->get();
+
+    if (pos_ != end_ && *pos_ == '#') {
+        while (pos_ != end_ && *pos_ != '\n') {
+            pos_++;
         }
     }
 }
 
 Token Tokenizer::ReadNumber() {
-    std::string num;
-    
-    while (!in_->eof() && std::isdigit(in_->peek())) {
-        num += static_cast<char>(in_->get());
+    const char* start = pos_;
+    int64_t value = 0;
+    bool overflow = false;
+
+    while (pos_ != end_ && IsDigit(*pos_)) {
+        int digit = *pos_ - '0';
+        if (value > (std::numeric_limits<int64_t>::max() - digit) / 10) {
+            overflow = true;
+        }
+        value = overflow ? 0 : value * 10 + digit;
+        pos_++;
     }
-    
-    try {
-        int value = std::stoi(num);
-        return ConstantToken{value};
-    } catch (const std::exception&) {
-        throw SyntaxError("Invalid number: " + num);
+
+    if (overflow) {
+        return ConstantToken{0, std::string_view(start, static_cast<size_t>(pos_ - start))};
     }
+
+    return ConstantToken{value, std::string_view()};
 }
 
-std::string Tokenizer::ReadIdentifier() {
-    std::string identifier;
-    
-    while (!in_->eof() && (std::isalnum(in_->peek()) || in_->peek() == '_')) {
-        identifier += static_cast<char>(in_->get());
+std::string_view Tokenizer::ReadIdentifier() {
+    const char* start = pos_;
+
+    while (pos_ != end_ && IsIdentifierChar(*pos_)) {
+        pos_++;
     }
-    
-    return identifier;
-}
\ No newline at end of file
+
+    return std::string_view(start, static_cast<size_t>(pos_ - start));
+}
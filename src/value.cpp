@@ -0,0 +1,118 @@
+#include "value.h"
+#include "bigint.h"
+#include <atomic>
+#include <charconv>
+#include <utility>
+
+// Constants of a shared Program are copied by every thread that runs it,
+// so the count is atomic.
+struct Value::Boxed {
+    std::atomic<uint32_t> references{1};
+    BigInt number;
+
+    explicit Boxed(BigInt number) : number(std::move(number)) {}
+};
+
+Value::Value(BigInt val) {
+    if (val.fitsInt64()) {
+        intValue = val.toInt64();
+        type = Type::Int;
+    } else {
+        bigValue = new Boxed(std::move(val));
+        type = Type::Big;
+    }
+}
+
+void Value::retain(Boxed* boxed) {
+    boxed->references.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Value::release(Boxed* boxed) {
+    if (boxed->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete boxed;
+    }
+}
+
+bool Value::parse(std::string_view text, Value& result) {
+    int64_t value = 0;
+    auto parsed = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (parsed.ec == std::errc() && parsed.ptr == text.data() + text.size()) {
+        result = Value(value);
+        return true;
+    }
+
+    BigInt big;
+    if (!BigInt::parse(text, big)) {
+        return false;
+    }
+    result = Value(big);
+    return true;
+}
+
+const BigInt& Value::asBig() const {
+    return bigValue->number;
+}
+
+BigInt Value::toBig() const {
+    return type == Type::Big ? bigValue->number : BigInt(intValue);
+}
+
+std::string Value::toString() const {
+    return type == Type::Big ? bigValue->number.toString() : std::to_string(intValue);
+}
+
+size_t Value::hash() const {
+    return type == Type::Big ? bigValue->number.hash() : static_cast<size_t>(intValue);
+}
+
+bool Value::operator==(const Value& other) const {
+    if (type != other.type) {
+        return false;
+    }
+    switch (type) {
+        case Type::Nil: return true;
+        case Type::Int: return intValue == other.intValue;
+        case Type::Big: return bigValue == other.bigValue || bigValue->number == other.bigValue->number;
+    }
+    return false;
+}
+
+namespace {
+
+// An operand of the slow path as a BigInt, borrowed from a big value and
+// only built for an inline one.
+struct Operand {
+    BigInt converted;
+    const BigInt& number;
+
+    explicit Operand(const Value& value)
+        : converted(value.isBig() ? BigInt() : BigInt(value.asInt())),
+          number(value.isBig() ? value.asBig() : converted) {}
+};
+
+}
+
+Value Value::addBig(const Value& left, const Value& right) {
+    return Value(Operand(left).number + Operand(right).number);
+}
+
+Value Value::subtractBig(const Value& left, const Value& right) {
+    return Value(Operand(left).number - Operand(right).number);
+}
+
+Value Value::multiplyBig(const Value& left, const Value& right) {
+    return Value(Operand(left).number * Operand(right).number);
+}
+
+Value Value::divideBig(const Value& left, const Value& right) {
+    return Value(Operand(left).number / Operand(right).number);
+}
+
+// A big value never fits in 64 bits, so it cannot equal an inline one.
+bool Value::equalBig(const Value& left, const Value& right) {
+    return left.type == right.type && left.bigValue->number == right.bigValue->number;
+}
+
+bool Value::lessBig(const Value& left, const Value& right) {
+    return Operand(left).number < Operand(right).number;
+}
@@ -0,0 +1,434 @@
+#include "vm.h"
+#include "error.h"
+#include "jit.h"
+#include "stats.h"
+#include <algorithm>
+#include <string>
+#include <utility>
+
+Frame::Frame(const CompiledFunction* function, Frame* parent, Frame* enclosing, size_t base)
+    : function(function), parent(parent && !parent->functions ? parent->parent : parent),
+      enclosing(enclosing), base(base) {
+    TOY_STAT(frames++);
+}
+
+void Frame::defineFunction(const CompiledFunction* nested) {
+    if (!functions) {
+        functions = std::make_unique<Functions>();
+    }
+    (*functions)[nested->name] = nested;
+}
+
+const CompiledFunction* Frame::findFunction(Symbol name, Frame** scope) {
+    TOY_STAT(functionLookups++);
+    for (Frame* frame = this; frame; frame = frame->parent) {
+        if (frame->functions) {
+            auto it = frame->functions->find(name);
+            if (it != frame->functions->end()) {
+                *scope = frame;
+                return it->second;
+            }
+        }
+        TOY_STAT(functionHops++);
+    }
+    return nullptr;
+}
+
+
+VirtualMachine::VirtualMachine(Frame& globals, CallBudget& budget) : globals(globals), budget(&budget) {}
+
+Value VirtualMachine::run(Symbol name, const std::vector<Value>& args) {
+    Frame* scope = nullptr;
+    const CompiledFunction* function = globals.findFunction(name, &scope);
+    if (!function) {
+        throw NameError("Function not found: " + symbolName(name));
+    }
+
+    if (function->params.size() != args.size()) {
+        throw RuntimeError("Incorrect number of arguments for function: " + symbolName(name));
+    }
+
+    overflowed.clear();
+    Value result;
+    if (jit && callNative(function, args.data(), args.size(), result)) {
+        return result;
+    }
+
+    if (profiler) {
+        Profiler::Call call(*profiler, function);
+        return start(function, scope, args);
+    }
+    return start(function, scope, args);
+}
+
+Value VirtualMachine::start(const CompiledFunction* function, Frame* scope, const std::vector<Value>& args) {
+    bool memoized = memo && function->pure;
+    Value result;
+    if (memoized && memo->lookup(function, args.data(), args.size(), result)) {
+        return result;
+    }
+
+    stack.clear();
+    callees.clear();
+    frames.clear();
+    memoKeys.clear();
+
+    stack.insert(stack.end(), args.begin(), args.end());
+    stack.resize(function->frameSize);
+    TOY_STAT(slotsAllocated += function->frameSize);
+
+    budget->enter();
+    frames.emplace_back(function, &globals, scope, 0);
+    TOY_STAT_PUSH_FRAME();
+    try {
+        result = execute();
+    } catch (...) {
+        unwind();
+        throw;
+    }
+    frames.clear();
+    TOY_STAT_POP_FRAMES(1);
+    budget->leave();
+
+    if (memoized) {
+        memo->store(function, args.data(), args.size(), result);
+    }
+    return result;
+}
+
+// Leaves the frames an exception escaped from, so that the profiler sees
+// their calls end.
+void VirtualMachine::unwind() {
+    for (auto frame = frames.rbegin(); frame != frames.rend(); ++frame) {
+        if (frame->profiled) {
+            profiler->exit();
+        }
+    }
+    TOY_STAT_POP_FRAMES(frames.size());
+    frames.clear();
+    memoKeys.clear();
+}
+
+bool VirtualMachine::callNative(const CompiledFunction* function, const Value* args, size_t argc, Value& result) {
+    const void* native = jit->find(function);
+    if (!native || (!overflowed.empty() && overflowed.count(function))) {
+        return false;
+    }
+    if (jit->call(native, args, argc, result)) {
+        return true;
+    }
+    overflowed.insert(function);
+    return false;
+}
+
+Value VirtualMachine::pop() {
+    Value value = std::move(stack.back());
+    stack.pop_back();
+    return value;
+}
+
+// Calls the pending callee with the `argc` arguments on top of the stack.
+// Returns true if that pushed a frame for the dispatch loop to run, and
+// false if the call is already over and its result is on the stack.
+bool VirtualMachine::enter(Frame& caller, size_t argc) {
+    PendingCall pending = callees.back();
+    callees.pop_back();
+
+    const CompiledFunction* function = pending.function;
+    size_t base = stack.size() - argc;
+    Value result;
+
+    // The JIT is off while memoizing or profiling, so a native call
+    // needs neither.
+    if (jit && callNative(function, stack.data() + base, argc, result)) {
+        stack.resize(base);
+        stack.push_back(std::move(result));
+        return false;
+    }
+
+    bool memoized = memo && function->pure;
+    if (memoized && memo->lookup(function, stack.data() + base, argc, result)) {
+        if (profiler) {
+            profiler->enter(function);
+            profiler->exit();
+        }
+        stack.resize(base);
+        stack.push_back(std::move(result));
+        return false;
+    }
+
+    pushFrame(pending, caller, base);
+    Frame& callee = frames.back();
+    if (memoized) {
+        memoKeys.push_back(MemoKey{function, std::vector<Value>(stack.begin() + base, stack.begin() + base + argc)});
+        callee.memoized = true;
+    }
+    if (profiler) {
+        profiler->enter(function);
+        callee.profiled = true;
+    }
+    return true;
+}
+
+// The arguments already on the stack become the callee's parameter slots;
+// the remaining locals start out Nil.
+void VirtualMachine::pushFrame(const PendingCall& pending, Frame& caller, size_t base) {
+    size_t frameSize = pending.function->frameSize;
+    if ((frames.size() + 1) * sizeof(Frame) + (base + frameSize) * sizeof(Value) > stackLimit) {
+        stackOverflow();
+    }
+    budget->enter();
+
+    stack.resize(base + frameSize);
+    TOY_STAT(slotsAllocated += frameSize);
+    frames.emplace_back(pending.function, &caller, pending.scope, base);
+    TOY_STAT_PUSH_FRAME();
+}
+
+void VirtualMachine::stackOverflow() const {
+    throw LimitError("Call stack limit of " + std::to_string(stackLimit) + " bytes exceeded");
+}
+
+// Returns from the frame on top, handing `result` to its caller. Returns
+// false instead if that frame is the one the run started with.
+bool VirtualMachine::leave(Value& result) {
+    if (frames.size() == 1) {
+        return false;
+    }
+
+    Frame& callee = frames.back();
+    if (callee.memoized) {
+        MemoKey& key = memoKeys.back();
+        memo->store(key.function, key.args.data(), key.args.size(), result);
+        memoKeys.pop_back();
+    }
+    if (callee.profiled) {
+        profiler->exit();
+    }
+    budget->leave();
+
+    size_t base = callee.base;
+    frames.pop_back();
+    TOY_STAT_POP_FRAMES(1);
+
+    stack.resize(base);
+    stack.push_back(std::move(result));
+    return true;
+}
+
+Value VirtualMachine::execute() {
+    Frame* frame = &frames.back();
+    const CompiledFunction* function = frame->function;
+    const Instruction* code = function->code.data();
+    size_t ip = 0;
+
+    // Runs the frame on top from where it stands: a callee from its start,
+    // a caller from after its call.
+    auto resume = [&] {
+        frame = &frames.back();
+        function = frame->function;
+        code = function->code.data();
+        ip = frame->ip;
+    };
+
+    for (;;) {
+        Instruction instr = code[ip++];
+        TOY_STAT(instructions[static_cast<size_t>(opcodeOf(instr))]++);
+
+        switch (opcodeOf(instr)) {
+            case OpCode::PUSH_CONST:
+                stack.push_back(function->constants[operandOf(instr)]);
+                break;
+
+            case OpCode::LOAD_LOCAL:
+                TOY_STAT(variableLookups++);
+                stack.push_back(stack[frame->base + operandOf(instr)]);
+                break;
+
+            case OpCode::LOAD_OUTER: {
+                const OuterRef& ref = function->outers[operandOf(instr)];
+                TOY_STAT(variableLookups++);
+                TOY_STAT(variableHops += ref.depth);
+                Frame* outer = frame;
+                for (uint32_t i = 0; i < ref.depth; i++) {
+                    outer = outer->enclosing;
+                }
+                Value value = stack[outer->base + ref.slot];
+                if (value.isNil()) {
+                    throw NameError("Undefined variable: " + symbolName(ref.name));
+                }
+                stack.push_back(value);
+                break;
+            }
+
+            case OpCode::STORE_LOCAL:
+                stack[frame->base + operandOf(instr)] = std::move(stack.back());
+                stack.pop_back();
+                break;
+
+            case OpCode::ADD: {
+                Value& left = stack[stack.size() - 2];
+                budget->operate(left, stack.back());
+                left = Value::add(left, stack.back());
+                stack.pop_back();
+                break;
+            }
+
+            case OpCode::SUB: {
+                Value& left = stack[stack.size() - 2];
+                budget->operate(left, stack.back());
+                left = Value::subtract(left, stack.back());
+                stack.pop_back();
+                break;
+            }
+
+            case OpCode::MUL: {
+                Value& left = stack[stack.size() - 2];
+                budget->operate(left, stack.back());
+                left = Value::multiply(left, stack.back());
+                stack.pop_back();
+                break;
+            }
+
+            case OpCode::DIV: {
+                if (stack.back().isZero()) {
+                    throw RuntimeError("Division by zero");
+                }
+                Value& left = stack[stack.size() - 2];
+                budget->operate(left, stack.back());
+                left = Value::divide(left, stack.back());
+                stack.pop_back();
+                break;
+            }
+
+            case OpCode::EQ: {
+                Value& left = stack[stack.size() - 2];
+                budget->operate(left, stack.back());
+                left = Value(Value::equal(left, stack.back()) ? 1 : 0);
+                stack.pop_back();
+                break;
+            }
+
+            case OpCode::NOT_EQ: {
+                Value& left = stack[stack.size() - 2];
+                budget->operate(left, stack.back());
+                left = Value(Value::equal(left, stack.back()) ? 0 : 1);
+                stack.pop_back();
+                break;
+            }
+
+            case OpCode::LESS: {
+                Value& left = stack[stack.size() - 2];
+                budget->operate(left, stack.back());
+                left = Value(Value::less(left, stack.back()) ? 1 : 0);
+                stack.pop_back();
+                break;
+            }
+
+            case OpCode::JUMP:
+                ip = operandOf(instr);
+                break;
+
+            case OpCode::JUMP_IF_FALSE:
+                if (stack.back().isZero()) {
+                    ip = operandOf(instr);
+                }
+                stack.pop_back();
+                break;
+
+            case OpCode::LOAD_FUNC: {
+                const CallSite& site = function->calls[operandOf(instr)];
+                Frame* scope = nullptr;
+                const CompiledFunction* target = frame->findFunction(site.callee, &scope);
+
+                if (!target) {
+                    throw NameError("Undefined function: " + symbolName(site.callee));
+                }
+                if (target->params.size() != site.argc) {
+                    throw RuntimeError("Function " + symbolName(site.callee) + " called with incorrect number of arguments");
+                }
+
+                callees.push_back(PendingCall{target, scope});
+                break;
+            }
+
+            case OpCode::TAIL_CALL: {
+                const CallSite& site = function->calls[operandOf(instr)];
+
+                // A frame that defined no functions cannot be reached by
+                // function lookup or as an enclosing scope, so the callee
+                // may take it over instead of growing the C++ stack.
+                if (frame->definesFunctions()) {
+                    frame->ip = static_cast<uint32_t>(ip);
+                    if (enter(*frame, site.argc)) {
+                        resume();
+                    }
+                    break;
+                }
+
+                PendingCall pending = callees.back();
+                callees.pop_back();
+
+                size_t args = stack.size() - site.argc;
+
+                if (profiler) {
+                    profiler->replace(pending.function);
+                }
+
+                // The tail callee's result is this frame's result, so a
+                // cached one can be returned directly. Misses are only
+                // stored by the call that started the chain.
+                Value result;
+                if ((memo && pending.function->pure &&
+                     memo->lookup(pending.function, stack.data() + args, site.argc, result)) ||
+                    (jit && callNative(pending.function, stack.data() + args, site.argc, result))) {
+                    if (!leave(result)) {
+                        return result;
+                    }
+                    resume();
+                    break;
+                }
+
+                TOY_STAT(tailCalls++);
+                budget->replace();
+                std::move(stack.begin() + args, stack.end(), stack.begin() + frame->base);
+                stack.resize(frame->base + site.argc);
+                stack.resize(frame->base + pending.function->frameSize);
+
+                frame->function = pending.function;
+                frame->enclosing = pending.scope;
+
+                function = frame->function;
+                code = function->code.data();
+                ip = 0;
+                break;
+            }
+
+            case OpCode::CALL:
+                frame->ip = static_cast<uint32_t>(ip);
+                if (enter(*frame, function->calls[operandOf(instr)].argc)) {
+                    resume();
+                }
+                break;
+
+            case OpCode::DEFINE_FUNC: {
+                const CompiledFunction* nested = function->nested[operandOf(instr)].get();
+                frame->defineFunction(nested);
+                break;
+            }
+
+            case OpCode::POP:
+                stack.pop_back();
+                break;
+
+            case OpCode::RETURN: {
+                Value result = pop();
+                if (!leave(result)) {
+                    return result;
+                }
+                resume();
+                break;
+            }
+        }
+    }
+}
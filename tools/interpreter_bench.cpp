@@ -0,0 +1,398 @@
+// Microbenchmarks for the tokenizer, parser and both engines. Results are
+// written as JSON so that runs can be stored and compared over time; each
+// benchmark is repeated and reports the median, with the fastest and
+// slowest repetition alongside.
+
+#include "tokenzier.h"
+#include "parser.h"
+#include "program.h"
+#include "interpreter.h"
+#include "jit.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+// The functions of test/test.toy, written with the operators the parser
+// supports (it has no `<=` or `>`) and without the top-level statements.
+const char* const TEST_FUNCTIONS = R"(def sum(a, b)
+    return a + b
+
+def factorial(n)
+    def helper(i, acc)
+        condition = i < n + 1
+        return if condition then helper(i + 1, acc * i) else acc
+    result = helper(1, 1)
+    return result
+
+def fibonacci(n)
+    def fib_helper(n, a, b)
+        condition = 0 < n
+        return if condition then fib_helper(n - 1, b, a + b) else a
+    return fib_helper(n, 0, 1)
+
+def is_even(n)
+    remainder = n / 2
+    remainder = remainder * 2
+    result = n == remainder
+    return result
+
+def power(base, exponent)
+    def power_helper(base, exponent, result)
+        condition = exponent == 0
+        return if condition then result else power_helper(base, exponent - 1, result * base)
+    return power_helper(base, exponent, 1)
+)";
+
+// One loop iteration makes two calls: `id` and the tail call.
+const char* const CALL_SOURCE = R"(def id(x)
+    return x
+
+def calls(n, acc)
+    return if n < 1 then acc else calls(n - 1, acc + id(1))
+)";
+
+// Every call to `id` is made from the deepest frame of the recursion, so
+// finding it by walking the callers costs as much as the stack is deep.
+const char* const LOOKUP_SOURCE = R"(def id(x)
+    return x
+
+def deep(n)
+    return if n < 1 then 0 else id(1) + deep(n - 1)
+)";
+
+// Every call but the last waits on the next one for its result.
+const char* const RECURSION_SOURCE = R"(def sum_to(n)
+    return if n < 1 then 0 else n + sum_to(n - 1)
+)";
+
+const char* const TAIL_SOURCE = R"(def loop(n)
+    return if n < 1 then 0 else loop(n - 1)
+)";
+
+// Each term is `n * 3 - n * 2 - n`, which is zero, so the accumulator
+// never overflows however long the loop runs.
+constexpr int ARITH_TERMS = 8;
+constexpr int ARITH_NODES_PER_TERM = 4;
+
+std::string arithSource() {
+    std::string expr;
+    for (int i = 0; i < ARITH_TERMS; i++) {
+        expr += i == 0 ? "" : " + ";
+        expr += "(n * 3 - n * 2 - n)";
+    }
+    return "def arith(n, acc)\n    return if n < 1 then acc else arith(n - 1, acc + " + expr + ")\n";
+}
+
+// Binary operators evaluated per iteration: the terms, the `+` between
+// them, and `n < 1`, `n - 1` and `acc + ...`.
+constexpr int ARITH_NODES = ARITH_TERMS * ARITH_NODES_PER_TERM + (ARITH_TERMS - 1) + 3;
+
+// A large script of distinct functions that mix every construct.
+std::string syntheticSource(int functions) {
+    std::ostringstream out;
+    for (int i = 0; i < functions; i++) {
+        out << "def f" << i << "(a, b)\n"
+            << "    x = a * " << i << " + b - (a / 3)\n"
+            << "    def g(c)\n"
+            << "        return if c < 3 then c + x else g(c - 1)\n"
+            << "    y = g(a) + sum(x, " << i << ")\n"
+            << "    return if x == y then x + y * 2 else y - x\n\n";
+    }
+    return out.str();
+}
+
+struct Options {
+    double minTime = 0.1;
+    int repetitions = 5;
+    std::string filter;
+};
+
+struct Result {
+    std::string name;
+    std::string unit;
+    size_t iterations;
+    double median;  // in `unit`
+    double best;
+    double worst;
+};
+
+class Runner {
+    const Options& options;
+    std::vector<Result> results;
+
+public:
+    explicit Runner(const Options& options) : options(options) {}
+
+    const std::vector<Result>& getResults() const { return results; }
+
+    // `body` is run in batches long enough to time reliably; `score` turns
+    // the seconds one call of `body` took into the reported value.
+    void run(const std::string& name, const std::string& unit, const std::function<void()>& body,
+             const std::function<double(double)>& score) {
+        if (name.find(options.filter) == std::string::npos) {
+            return;
+        }
+
+        size_t iterations = 1;
+        while (true) {
+            double seconds = time(body, iterations);
+            if (seconds >= options.minTime || iterations >= (size_t(1) << 30)) {
+                break;
+            }
+            double factor = seconds > 0 ? options.minTime / seconds * 1.2 : 10;
+            iterations = static_cast<size_t>(static_cast<double>(iterations) * std::min(10.0, std::max(2.0, factor)));
+        }
+
+        std::vector<double> scores;
+        for (int i = 0; i < options.repetitions; i++) {
+            scores.push_back(score(time(body, iterations) / static_cast<double>(iterations)));
+        }
+        std::sort(scores.begin(), scores.end());
+
+        double median = scores[scores.size() / 2];
+        std::cerr << name << ": " << median << " " << unit << std::endl;
+
+        // Smaller is better for times, larger for rates, so keep `best` honest.
+        bool isTime = unit.rfind("ns", 0) == 0;
+        results.push_back({name, unit, iterations, median, isTime ? scores.front() : scores.back(),
+                           isTime ? scores.back() : scores.front()});
+    }
+
+private:
+    static double time(const std::function<void()>& body, size_t iterations) {
+        auto start = Clock::now();
+        for (size_t i = 0; i < iterations; i++) {
+            body();
+        }
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+};
+
+void lex(const std::string& source) {
+    Tokenizer tokenizer{std::string_view(source)};
+    while (!tokenizer.IsEnd()) {
+        tokenizer.Next();
+    }
+}
+
+void parse(const std::string& source) {
+    Tokenizer tokenizer{std::string_view(source)};
+    Parser parser(&tokenizer);
+    parser.parseProgram();
+}
+
+const char* engineName(Engine engine) {
+    switch (engine) {
+        case Engine::Bytecode: return "bytecode";
+        case Engine::TreeWalker: return "tree";
+        case Engine::Jit: return "jit";
+    }
+    return "";
+}
+
+void benchmarkFrontEnd(Runner& runner) {
+    const int functions = 2000;
+    std::string synthetic = syntheticSource(functions);
+    std::string test = TEST_FUNCTIONS;
+
+    auto megabytesPerSecond = [](size_t bytes) {
+        return [bytes](double seconds) { return static_cast<double>(bytes) / seconds / 1e6; };
+    };
+    auto nanosecondsPer = [](double count) {
+        return [count](double seconds) { return seconds * 1e9 / count; };
+    };
+
+    runner.run("lex/synthetic", "MB/s", [&] { lex(synthetic); }, megabytesPerSecond(synthetic.size()));
+    runner.run("lex/test.toy", "MB/s", [&] { lex(test); }, megabytesPerSecond(test.size()));
+    runner.run("parse/synthetic", "ns/function", [&] { parse(synthetic); }, nanosecondsPer(functions));
+    runner.run("parse/test.toy", "ns/function", [&] { parse(test); }, nanosecondsPer(5));
+    runner.run("load/synthetic", "ns/function", [&] { Program program{std::string_view(synthetic)}; },
+               nanosecondsPer(functions));
+}
+
+void benchmarkEngine(Runner& runner, Engine engine) {
+    std::string suffix = std::string("/") + engineName(engine);
+    // Inlining would take the calls out of the call cases.
+    auto context = [engine](const std::string& source, size_t inlineLimit = 0) {
+        return std::make_unique<ExecutionContext>(
+            std::make_shared<const Program>(std::string_view(source), true, inlineLimit), engine);
+    };
+    auto nanosecondsPer = [](double count) {
+        return [count](double seconds) { return seconds * 1e9 / count; };
+    };
+
+    const int loops = 10000;
+
+    auto calls = context(CALL_SOURCE);
+    runner.run("call" + suffix, "ns/call", [&] { calls->run("calls", {Value(loops), Value(0)}); }, nanosecondsPer(2.0 * loops));
+
+    // The same loop with `id` inlined, still counted as two calls.
+    auto inlined = context(CALL_SOURCE, Inliner::DEFAULT_LIMIT);
+    runner.run("inlinedcall" + suffix, "ns/call", [&] { inlined->run("calls", {Value(loops), Value(0)}); },
+               nanosecondsPer(2.0 * loops));
+
+    auto arith = context(arithSource());
+    runner.run("arith" + suffix, "Mnodes/s", [&] { arith->run("arith", {Value(loops), Value(0)}); },
+               [](double seconds) { return static_cast<double>(ARITH_NODES) * loops / seconds / 1e6; });
+
+    // Deep enough that anything but a constant-space tail call would
+    // overflow the native stack.
+    const int depth = 1000000;
+    auto tail = context(TAIL_SOURCE);
+    runner.run("tailcall" + suffix, "ns/call", [&] { tail->run("loop", {Value(depth)}); }, nanosecondsPer(depth));
+
+    const int recursionDepth = 10000;
+    auto recursion = context(RECURSION_SOURCE);
+    runner.run("recursion" + suffix, "ns/call", [&] { recursion->run("sum_to", {Value(recursionDepth)}); },
+               nanosecondsPer(recursionDepth));
+
+    const int lookupDepth = 1000;
+    auto lookup = context(LOOKUP_SOURCE);
+    runner.run("deeplookup" + suffix, "ns/call", [&] { lookup->run("deep", {Value(lookupDepth)}); },
+               nanosecondsPer(2.0 * lookupDepth));
+
+    auto test = context(TEST_FUNCTIONS);
+    const std::vector<std::pair<std::string, std::vector<Value>>> cases = {
+        {"sum", {Value(2), Value(3)}}, {"factorial", {Value(10)}}, {"fibonacci", {Value(30)}},
+        {"is_even", {Value(1234)}}, {"power", {Value(2), Value(20)}},
+    };
+    for (const auto& [function, args] : cases) {
+        runner.run("test.toy/" + function + suffix, "ns/run", [&] { test->run(function, args); }, nanosecondsPer(1));
+    }
+}
+
+// The test.toy functions that make no calls, run over a column of rows
+// with runColumns and, for comparison, one run per row.
+void benchmarkLanes(Runner& runner, Engine engine) {
+    std::string suffix = std::string("/") + engineName(engine);
+    ExecutionContext context(std::make_shared<const Program>(std::string_view(TEST_FUNCTIONS)), engine);
+
+    const size_t rows = 4096;
+    std::vector<int64_t> first(rows), second(rows), results(rows);
+    for (size_t i = 0; i < rows; i++) {
+        first[i] = static_cast<int64_t>(i * 7919 % 100000);
+        second[i] = static_cast<int64_t>(i % 1000) - 500;
+    }
+
+    auto nanosecondsPerRow = [rows](double seconds) { return seconds * 1e9 / static_cast<double>(rows); };
+    const std::vector<std::pair<std::string, std::vector<const int64_t*>>> cases = {
+        {"sum", {first.data(), second.data()}}, {"is_even", {first.data()}},
+    };
+    for (const auto& [function, args] : cases) {
+        runner.run("lanes/" + function + suffix, "ns/row",
+                   [&] { context.runColumns(function, args, rows, results.data()); }, nanosecondsPerRow);
+        runner.run("rows/" + function + suffix, "ns/row", [&] {
+            std::vector<Value> values(args.size());
+            for (size_t row = 0; row < rows; row++) {
+                for (size_t i = 0; i < args.size(); i++) {
+                    values[i] = Value(args[i][row]);
+                }
+                results[row] = context.run(function, values).asInt();
+            }
+        }, nanosecondsPerRow);
+    }
+}
+
+std::string jsonString(const std::string& text) {
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        out += c;
+    }
+    return out + "\"";
+}
+
+void writeJson(std::ostream& out, const Options& options, const std::vector<Result>& results) {
+    char date[32];
+    std::time_t now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+    out << "{\n"
+        << "  \"context\": {\n"
+        << "    \"date\": " << jsonString(date) << ",\n"
+#ifdef __VERSION__
+        << "    \"compiler\": " << jsonString(__VERSION__) << ",\n"
+#endif
+        << "    \"build_type\": " << jsonString(TOY_BUILD_TYPE) << ",\n"
+        << "    \"stats\": " << (RuntimeStats::enabled ? "true" : "false") << ",\n"
+        << "    \"repetitions\": " << options.repetitions << ",\n"
+        << "    \"min_time\": " << options.minTime << "\n"
+        << "  },\n"
+        << "  \"benchmarks\": [";
+
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& result = results[i];
+        out << (i == 0 ? "\n" : ",\n")
+            << "    {\"name\": " << jsonString(result.name)
+            << ", \"unit\": " << jsonString(result.unit)
+            << ", \"iterations\": " << result.iterations
+            << ", \"median\": " << result.median
+            << ", \"best\": " << result.best
+            << ", \"worst\": " << result.worst << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    std::string outputPath;
+
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        if (option.rfind("--min-time=", 0) == 0) {
+            options.minTime = std::stod(option.substr(11));
+        } else if (option.rfind("--repetitions=", 0) == 0) {
+            options.repetitions = std::max(1, std::stoi(option.substr(14)));
+        } else if (option.rfind("--filter=", 0) == 0) {
+            options.filter = option.substr(9);
+        } else if (option.rfind("--output=", 0) == 0) {
+            outputPath = option.substr(9);
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--min-time=SECONDS] [--repetitions=N] [--filter=TEXT] [--output=PATH]" << std::endl;
+            return 1;
+        }
+    }
+
+    Runner runner(options);
+    try {
+        benchmarkFrontEnd(runner);
+        benchmarkEngine(runner, Engine::Bytecode);
+        benchmarkEngine(runner, Engine::TreeWalker);
+        benchmarkLanes(runner, Engine::Bytecode);
+        if (JitModule::isSupported()) {
+            benchmarkEngine(runner, Engine::Jit);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    if (outputPath.empty()) {
+        writeJson(std::cout, options, runner.getResults());
+    } else {
+        std::ofstream out(outputPath);
+        writeJson(out, options, runner.getResults());
+        if (!out) {
+            std::cerr << "Could not write " << outputPath << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,149 @@
+// Measures latency and throughput of a running `interpreter --serve=PATH`.
+// Every client connects separately and keeps up to `depth` requests in
+// flight, so depth 1 measures round trips and larger depths measure
+// pipelined throughput.
+
+#include "unix_socket.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct ClientStats {
+    std::vector<double> latencies;  // microseconds
+    size_t errors = 0;
+};
+
+void runClient(const std::string& path, const std::string& request, size_t requests, size_t depth,
+               ClientStats& stats) {
+    int fd = connectUnix(path);
+    LineReader replies(fd);
+    std::deque<Clock::time_point> inflight;
+    std::string pending;
+    std::string reply;
+    size_t sent = 0;
+
+    stats.latencies.reserve(requests);
+
+    while (stats.latencies.size() < requests) {
+        while (sent < requests && inflight.size() < depth) {
+            pending += request;
+            inflight.push_back(Clock::now());
+            sent++;
+        }
+        if (!pending.empty()) {
+            writeAll(fd, pending.data(), pending.size());
+            pending.clear();
+        }
+
+        if (!replies.next(reply)) {
+            throw std::runtime_error("Server closed the connection");
+        }
+        auto elapsed = Clock::now() - inflight.front();
+        inflight.pop_front();
+        stats.latencies.push_back(std::chrono::duration<double, std::micro>(elapsed).count());
+        if (reply.compare(0, 3, "OK ") != 0) {
+            stats.errors++;
+        }
+    }
+
+    ::close(fd);
+}
+
+double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t index = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    size_t clients = 4;
+    size_t requests = 10000;
+    size_t depth = 1;
+    int argi = 1;
+
+    for (; argi < argc && std::string(argv[argi]).rfind("--", 0) == 0; argi++) {
+        std::string option = argv[argi];
+        if (option.rfind("--clients=", 0) == 0) {
+            clients = std::stoul(option.substr(10));
+        } else if (option.rfind("--requests=", 0) == 0) {
+            requests = std::stoul(option.substr(11));
+        } else if (option.rfind("--depth=", 0) == 0) {
+            depth = std::max<size_t>(1, std::stoul(option.substr(8)));
+        } else {
+            std::cerr << "Unknown option: " << option << std::endl;
+            return 1;
+        }
+    }
+
+    if (argc - argi < 2) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--clients=N] [--requests=N] [--depth=N] <socket> <function> [args...]" << std::endl;
+        return 1;
+    }
+
+    std::string path = argv[argi];
+    std::string request = argv[argi + 1];
+    for (int i = argi + 2; i < argc; i++) {
+        request += ' ';
+        request += argv[i];
+    }
+    request += '\n';
+
+    std::vector<ClientStats> stats(clients);
+    std::vector<std::thread> threads;
+    std::vector<std::string> failures(clients);
+
+    auto start = Clock::now();
+    for (size_t i = 0; i < clients; i++) {
+        threads.emplace_back([&, i] {
+            try {
+                runClient(path, request, requests, depth, stats[i]);
+            } catch (const std::exception& e) {
+                failures[i] = e.what();
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    for (const std::string& failure : failures) {
+        if (!failure.empty()) {
+            std::cerr << "Error: " << failure << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<double> latencies;
+    size_t errors = 0;
+    for (const ClientStats& client : stats) {
+        latencies.insert(latencies.end(), client.latencies.begin(), client.latencies.end());
+        errors += client.errors;
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    std::printf("clients %zu, depth %zu, %zu requests in %.3f s\n", clients, depth, latencies.size(), seconds);
+    std::printf("throughput %.0f req/s\n", static_cast<double>(latencies.size()) / seconds);
+    std::printf("latency us: p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n",
+                percentile(latencies, 0.50), percentile(latencies, 0.90),
+                percentile(latencies, 0.99), latencies.empty() ? 0.0 : latencies.back());
+    if (errors > 0) {
+        std::printf("error replies %zu\n", errors);
+    }
+
+    return 0;
+}
@@ -0,0 +1,55 @@
+// Sends the requests on stdin to a running `interpreter --serve=PATH` and
+// prints one reply per request. Requests are written without waiting for
+// replies, so the server sees them pipelined.
+
+#include "unix_socket.h"
+#include <iostream>
+#include <string>
+#include <thread>
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        std::cerr << "Usage: " << argv[0] << " <socket>" << std::endl;
+        return 1;
+    }
+
+    try {
+        int fd = connectUnix(argv[1]);
+
+        std::ios::sync_with_stdio(false);
+
+        std::thread writer([fd] {
+            try {
+                std::string line;
+                std::string pending;
+                while (std::getline(std::cin, line)) {
+                    pending += line;
+                    pending += '\n';
+                    if (pending.size() >= 65536 || std::cin.rdbuf()->in_avail() <= 0) {
+                        writeAll(fd, pending.data(), pending.size());
+                        pending.clear();
+                    }
+                }
+                writeAll(fd, pending.data(), pending.size());
+            } catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << std::endl;
+            }
+            ::shutdown(fd, SHUT_WR);
+        });
+
+        LineReader replies(fd);
+        std::string reply;
+        while (replies.next(reply)) {
+            std::cout << reply << '\n';
+        }
+        std::cout.flush();
+
+        writer.join();
+        ::close(fd);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
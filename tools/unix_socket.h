@@ -0,0 +1,82 @@
+#ifndef TOY_LANG_TOOLS_UNIX_SOCKET
+#define TOY_LANG_TOOLS_UNIX_SOCKET
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Helpers shared by the tools that talk to `interpreter --serve=PATH`.
+
+inline int connectUnix(const std::string& path) {
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Socket path too long: " + path);
+    }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        std::string reason = std::strerror(errno);
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        throw std::runtime_error("Could not connect to " + path + ": " + reason);
+    }
+    return fd;
+}
+
+inline void writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("Write failed: " + std::string(std::strerror(errno)));
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+}
+
+// Splits a byte stream into lines.
+class LineReader {
+    int fd;
+    std::string buffer;
+    size_t start = 0;
+
+public:
+    explicit LineReader(int fd) : fd(fd) {}
+
+    // Returns false once the peer has closed the connection.
+    bool next(std::string& line) {
+        for (;;) {
+            size_t newline = buffer.find('\n', start);
+            if (newline != std::string::npos) {
+                line.assign(buffer, start, newline - start);
+                start = newline + 1;
+                return true;
+            }
+
+            buffer.erase(0, start);
+            start = 0;
+
+            char chunk[65536];
+            ssize_t n = ::read(fd, chunk, sizeof(chunk));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            buffer.append(chunk, static_cast<size_t>(n));
+        }
+    }
+};
+
+#endif